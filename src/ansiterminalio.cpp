@@ -0,0 +1,164 @@
+#include "ansiterminalio.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#define ENTER_SCREEN "\x1b[?1049h\x1b[?25l\x1b[2J"      // Alternate screen, hidden cursor
+#define LEAVE_SCREEN "\x1b[0m\x1b[?25h\x1b[?1049l"
+#define COLOURS "\x1b[97;40m"                          // White on black, like the ncurses display
+
+// Clean cells up to this long between dirty ones cost less to repaint than
+// a cursor move costs to skip
+#define MAX_BRIDGED_GAP 2
+
+// Indexed by top pixel | bottom pixel << 1
+static const char glyphs[4][4] = { " ", "\xe2\x96\x80", "\xe2\x96\x84", "\xe2\x96\x88" };
+static const unsigned char glyphSizes[4] = { 1, 3, 3, 3 };
+
+static char* appendNumber(char* out, unsigned int number)
+{
+    if(number >= 10)
+        *out++ = '0' + number / 10;
+    *out++ = '0' + number % 10;
+
+    return out;
+}
+
+// Both neighbours within MAX_BRIDGED_GAP cells are dirty
+static FrameRow bridgeGaps(FrameRow changed)
+{
+    static_assert(MAX_BRIDGED_GAP == 2, "bridgeGaps only handles gaps of up to two cells");
+
+    return changed | ((changed << 1) & (changed >> 1)) |
+                     ((changed << 1) & (changed >> 2)) |
+                     ((changed << 2) & (changed >> 1));
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+AnsiTerminalIO::AnsiTerminalIO()
+    : restore(tcgetattr(STDIN_FILENO, &saved) == 0)
+{
+    // Keys arrive as they are typed and are not echoed, signals still work
+    if(restore)
+    {
+        termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN]  = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    output(ENTER_SCREEN, sizeof(ENTER_SCREEN) - 1);
+    keypad.start();
+}
+
+AnsiTerminalIO::~AnsiTerminalIO()
+{
+    keypad.stop();
+    output(LEAVE_SCREEN, sizeof(LEAVE_SCREEN) - 1);
+
+    if(restore)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void AnsiTerminalIO::draw(const unsigned char* gfx)
+{
+    FrameRow rows[DISPLAY_LINES] = {};
+
+    for(int y = 0; y < DISPLAY_LINES; y++)
+        for(int x = 0; x < DISPLAY_COLUMNS; x++)
+            rows[y] |= (FrameRow)(gfx[x + (y * DISPLAY_COLUMNS)] & 1) << x;
+
+    draw(rows);
+}
+
+void AnsiTerminalIO::draw(const FrameRow* rows)
+{
+    FrameRow dirty[DISPLAY_LINES];
+
+    for(int y = 0; y < DISPLAY_LINES; y++)
+        dirty[y] = ~(FrameRow)0;
+
+    draw(rows, dirty);
+}
+
+void AnsiTerminalIO::draw(const FrameRow* rows, const FrameRow* dirty)
+{
+    char* out = frame;
+
+    std::memcpy(out, COLOURS, sizeof(COLOURS) - 1);
+    out += sizeof(COLOURS) - 1;
+    char* start = out;
+
+    for(int line = 0; line < TERMINAL_LINES; line++)
+    {
+        FrameRow top = rows[line * 2];
+        FrameRow bottom = rows[line * 2 + 1];
+        FrameRow changed = bridgeGaps(dirty[line * 2] | dirty[line * 2 + 1]);
+
+        // One cursor move per run of changed cells, then the cells
+        for(int x = 0; x < DISPLAY_COLUMNS; x++)
+        {
+            if(!((changed >> x) & 1))
+                continue;
+
+            *out++ = '\x1b';
+            *out++ = '[';
+            out = appendNumber(out, line + 1);
+            *out++ = ';';
+            out = appendNumber(out, x + 1);
+            *out++ = 'H';
+
+            for(; x < DISPLAY_COLUMNS && ((changed >> x) & 1); x++)
+            {
+                int cell = ((top >> x) & 1) | (((bottom >> x) & 1) << 1);
+
+                std::memcpy(out, glyphs[cell], glyphSizes[cell]);
+                out += glyphSizes[cell];
+            }
+        }
+    }
+
+    if(out != start)
+        output(frame, out - frame);
+}
+
+// The keypad thread keeps the mask current
+void AnsiTerminalIO::updateKeys()
+{
+
+}
+
+bool AnsiTerminalIO::isKeyPressed(unsigned char keyValue)
+{
+    return keyMask() & (1 << keyValue);
+}
+
+unsigned short AnsiTerminalIO::keyMask()
+{
+    return keypad.keyMask();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// One write() unless the terminal takes the frame in pieces
+void AnsiTerminalIO::output(const char* bytes, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t written = write(STDOUT_FILENO, bytes, size);
+
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return;
+        }
+
+        bytes += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef _ANSITERMINALIO_H
+#define _ANSITERMINALIO_H
+
+#include "io.h"
+#include "terminalkeypad.h"
+#include <cstddef>
+#include <termios.h>
+
+#define TERMINAL_LINES (DISPLAY_LINES / 2)
+
+// Worst case, a cursor move and the widest glyph for every cell
+#define ANSI_FRAME_SIZE (16 + TERMINAL_LINES * DISPLAY_COLUMNS * (sizeof("\x1b[16;64H") - 1 + 3))
+
+/*
+ * Terminal display written with plain ANSI escapes, no curses. Each cell
+ * holds two pixel rows as a space or a half or full block, so the display
+ * takes 64x16 cells. A frame repaints only the cells over dirty pixels,
+ * built into one buffer and handed to the terminal with a single write().
+ * The terminal needs UTF-8 for the block glyphs.
+ */
+class AnsiTerminalIO final : public IO
+{
+public:
+    /* Constructors, operators, and destructor */
+    AnsiTerminalIO();
+    AnsiTerminalIO(const AnsiTerminalIO& other) = delete;
+    AnsiTerminalIO& operator=(const AnsiTerminalIO& other) = delete;
+    ~AnsiTerminalIO();
+
+    /* Video */
+    virtual void draw(const unsigned char* gfx) override;
+    virtual void draw(const FrameRow* rows) override;
+    virtual void draw(const FrameRow* rows, const FrameRow* dirty) override;
+
+    /* Input */
+    using IO::updateKeys;
+    virtual void updateKeys() override;
+    virtual bool isKeyPressed(unsigned char keyValue) override;
+    virtual unsigned short keyMask() override;
+private:
+    /* Auxiliary methods */
+    static void output(const char* bytes, size_t size);
+private:
+    termios saved;
+    bool restore;
+    char frame[ANSI_FRAME_SIZE];
+    TerminalKeypad keypad;
+};
+
+#endif  // _ANSITERMINALIO_H
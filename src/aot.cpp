@@ -0,0 +1,339 @@
+#include "emulator.h"
+#include "registerinstructions.h"
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define PROGRAM_LOCATION 0x200
+#define MAX_BLOCK_LENGTH 64             // Must split blocks exactly like the emulator
+#define ADDRESS(instruction) (instruction & 0xfff)
+#define REGISTER_X(instruction) ((instruction >> 8) & 0xf)
+#define REGISTER_Y(instruction) ((instruction >> 4) & 0xf)
+#define SECOND_ARG(instruction) (instruction & 0xff)
+#define THIRD_ARG(instruction) (instruction & 0xf)
+
+static const char* profileEnumerators[NUM_QUIRK_PROFILES] = {
+    "Default", "CosmacVIP", "Chip48", "SuperChip", "XoChip"
+};
+
+struct Block
+{
+    unsigned char length;
+    std::vector<std::string> body;      // Empty when the body has to be interpreted
+};
+
+class Program
+{
+public:
+    Program(const std::vector<unsigned char>& rom, QuirkProfile quirks)
+        : rom(rom), quirks(quirks)
+    {
+
+    }
+
+    // Follow every statically known path from the entry point
+    void discover()
+    {
+        std::vector<unsigned int> pending = { PROGRAM_LOCATION };
+
+        while(!pending.empty())
+        {
+            unsigned int address = pending.back();
+            pending.pop_back();
+
+            if(address & 1 || !inRom(address) || blocks.count(address) || unreachable.count(address))
+                continue;
+
+            unsigned char length = lengthAt(address);
+            if(!length)
+            {
+                unreachable.insert(address);
+                continue;
+            }
+
+            Block& block = blocks[address];
+            block.length = length;
+            translate(address, block);
+
+            unsigned int last = address + (length - 1) * 2;
+            for(unsigned int successor : successors(last))
+                pending.push_back(successor);
+        }
+    }
+
+    void emit(std::ostream& out, const std::string& source) const
+    {
+        unsigned int compiled = 0;
+        char line[96];
+
+        out << "// Generated by chip8aot from " << source << " for the "
+            << quirkProfileName(quirks) << " quirk profile, do not edit\n\n"
+            << "#include \"precompiled.h\"\n"
+            << "#include \"registerinstructions.h\"\n\n"
+            << "static const unsigned char rom[] = {";
+        for(std::size_t i = 0; i < rom.size(); i++)
+        {
+            std::snprintf(line, sizeof(line), "%s0x%02x,", i % 16 ? " " : "\n    ", rom[i]);
+            out << line;
+        }
+        out << "\n};\n";
+
+        for(const auto& entry : blocks)
+        {
+            if(entry.second.body.empty())
+                continue;
+
+            std::snprintf(line, sizeof(line), "\n// 0x%03x, %d instructions\nstatic void block_%03x(GeneralRegister* V, SpecialRegister* I)\n{\n",
+                          entry.first, entry.second.length, entry.first);
+            out << line;
+            for(const std::string& statement : entry.second.body)
+                out << "    " << statement << "\n";
+            out << "}\n";
+            compiled++;
+        }
+
+        out << "\nstatic const PrecompiledBlock blocks[] = {\n";
+        for(const auto& entry : blocks)
+            if(!entry.second.body.empty())
+            {
+                std::snprintf(line, sizeof(line), "    { 0x%03x, %d, block_%03x },\n", entry.first, entry.second.length, entry.first);
+                out << line;
+            }
+        if(!compiled)
+            out << "    { 0, 0, nullptr },\n";
+        out << "};\n\n";
+
+        out << "static const PrecompiledProgram program = {\n"
+            << "    \"" << escape(source) << "\", rom, sizeof(rom), QuirkProfile::" << profileEnumerators[(int)quirks] << ",\n"
+            << "    blocks, " << compiled << "\n"
+            << "};\n\n"
+            << "static PrecompiledRegistration registration(program);\n";
+    }
+
+    unsigned int numBlocks() const
+    {
+        return blocks.size();
+    }
+
+    unsigned int numCompiled() const
+    {
+        unsigned int compiled = 0;
+
+        for(const auto& entry : blocks)
+            compiled += !entry.second.body.empty();
+
+        return compiled;
+    }
+private:
+    bool inRom(unsigned int address) const
+    {
+        return address >= PROGRAM_LOCATION && address + 1 < PROGRAM_LOCATION + rom.size();
+    }
+
+    unsigned short instructionAt(unsigned int address) const
+    {
+        return rom[address - PROGRAM_LOCATION] << 8 | rom[address - PROGRAM_LOCATION + 1];
+    }
+
+    // CHIP8Emulator::blockAt over the ROM, 0 when the block runs past it
+    unsigned char lengthAt(unsigned int address) const
+    {
+        unsigned int slot = address / 2;
+
+        while(true)
+        {
+            if(!inRom(slot * 2))
+                return 0;
+            if(CHIP8Emulator::isBlockTerminator(instructionAt(slot * 2)) ||
+               slot - address / 2 + 1 == MAX_BLOCK_LENGTH || slot + 1 == MEMORY_SIZE / 2)
+                break;
+            slot++;
+        }
+
+        return slot - address / 2 + 1;
+    }
+
+    // Where execution can go after the last instruction of a block, BNNN
+    // and returns are left to the interpreter
+    std::vector<unsigned int> successors(unsigned int address) const
+    {
+        unsigned short instruction = instructionAt(address);
+
+        if(!CHIP8Emulator::isBlockTerminator(instruction))
+            return { address + 2 };
+
+        switch(instruction >> 12)
+        {
+        case 0x0:
+        case 0xb:
+            return {};
+        case 0x1:
+            return { (unsigned int)ADDRESS(instruction) };
+        case 0x2:
+            return { (unsigned int)ADDRESS(instruction), address + 2 };
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xe:
+            return { address + 2, address + 4 };
+        }
+
+        return { address + 2 };
+    }
+
+    void translate(unsigned int address, Block& block) const
+    {
+        for(unsigned char i = 0; i + 1 < block.length; i++)
+        {
+            unsigned short instruction = instructionAt(address + i * 2);
+
+            if(!translate(instruction, block.body))
+            {
+                block.body.clear();
+                return;
+            }
+        }
+    }
+
+    // Calls into RegisterInstructions, the code the interpreter runs, so a
+    // generated block computes exactly what the interpreted one would
+    bool translate(unsigned short instruction, std::vector<std::string>& body) const
+    {
+        static const char* registerOperations[16] = {
+            "registerMov", "registerOr", "registerAnd", "registerXor", "registerAdd", "registerSub", "registerShiftRight", "registerMinus",
+            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "registerShiftLeft", nullptr
+        };
+
+        int x = REGISTER_X(instruction);
+        int y = REGISTER_Y(instruction);
+        char statement[96];
+
+        if(!RegisterInstructions::isBodyInstruction(instruction))
+            return false;
+
+        switch(instruction >> 12)
+        {
+        case 0x6:
+            std::snprintf(statement, sizeof(statement), "RegisterInstructions::movValue(V, 0x%x, 0x%02x);", x, SECOND_ARG(instruction));
+            break;
+        case 0x7:
+            std::snprintf(statement, sizeof(statement), "RegisterInstructions::addValue(V, 0x%x, 0x%02x);", x, SECOND_ARG(instruction));
+            break;
+        case 0x8:
+        {
+            const char* operation = registerOperations[THIRD_ARG(instruction)];
+            bool shift = THIRD_ARG(instruction) == 0x6 || THIRD_ARG(instruction) == 0xe;
+
+            if(!operation)
+                return true;
+
+            std::snprintf(statement, sizeof(statement), "RegisterInstructions::%s%s(V, 0x%x, 0x%x);", operation,
+                          !shift ? "" : quirkShiftUsesVY(quirks) ? "<true>" : "<false>", x, y);
+            break;
+        }
+        case 0xa:
+            std::snprintf(statement, sizeof(statement), "RegisterInstructions::movAddress(I, 0x%03x);", ADDRESS(instruction));
+            break;
+        case 0xf:
+            if(SECOND_ARG(instruction) != 0x1e)
+                return true;
+            std::snprintf(statement, sizeof(statement), "RegisterInstructions::addIndex(V, I, 0x%x);", x);
+            break;
+        default:
+            // 0NNN other than 00E0 does nothing
+            return true;
+        }
+
+        body.push_back(statement);
+
+        return true;
+    }
+
+    static std::string escape(const std::string& text)
+    {
+        std::string escaped;
+
+        for(char c : text)
+        {
+            if(c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += std::isprint((unsigned char)c) ? c : '?';
+        }
+
+        return escaped;
+    }
+private:
+    const std::vector<unsigned char>& rom;
+    QuirkProfile quirks;
+    std::map<unsigned int, Block> blocks;
+    std::set<unsigned int> unreachable;
+};
+
+int main(int argc, char **argv)
+{
+    QuirkProfile quirks = QuirkProfile::Default;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--quirks" && argument + 1 < argc)
+        {
+            if(!parseQuirkProfile(argv[++argument], quirks))
+            {
+                std::cerr << "Unknown quirk profile " << argv[argument] << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument >= argc)
+    {
+        std::cerr << "Usage: chip8aot [--quirks PROFILE] program.ch8 > program.cpp" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ifstream file(argv[argument], std::ios::binary);
+        if(!file)
+            throw std::runtime_error(std::string("Could not open ") + argv[argument]);
+
+        std::vector<unsigned char> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if(rom.empty())
+            throw std::runtime_error(std::string(argv[argument]) + " is empty");
+        if(rom.size() > MEMORY_SIZE - PROGRAM_LOCATION)
+            rom.resize(MEMORY_SIZE - PROGRAM_LOCATION);
+
+        std::string source = argv[argument];
+        source = source.substr(source.find_last_of('/') + 1);
+
+        Program program(rom, quirks);
+        program.discover();
+        program.emit(std::cout, source);
+
+        std::cerr << source << ": " << program.numCompiled() << " of " << program.numBlocks()
+                  << " reachable blocks compiled" << std::endl;
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
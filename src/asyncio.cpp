@@ -0,0 +1,134 @@
+#include "asyncio.h"
+#include <chrono>
+#include <cstring>
+
+#define SLOT_MASK 0x3
+#define FRESH 0x4
+
+// Bounds the delay when a wakeup slips in before the renderer waits
+#define RENDER_POLL std::chrono::milliseconds(16)
+
+AsyncIO::AsyncIO(IO& target)
+    : target(target), back(0), middle(1), dropped(0), front(2), stopping(false)
+{
+    std::memset(slots, 0, sizeof(slots));
+    std::memset(shown, 0, sizeof(shown));
+
+    renderer = std::thread(&AsyncIO::render, this);
+}
+
+AsyncIO::~AsyncIO()
+{
+    // The renderer presents the last frame before it leaves
+    stopping = true;
+    frameReady.notify_one();
+
+    renderer.join();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void AsyncIO::draw(const unsigned char* gfx)
+{
+    FrameRow* rows = slots[back];
+
+    for(int y = 0; y < DISPLAY_LINES; y++)
+    {
+        rows[y] = 0;
+        for(int x = 0; x < DISPLAY_COLUMNS; x++)
+            rows[y] |= (FrameRow)(gfx[x + (y * DISPLAY_COLUMNS)] & 1) << x;
+    }
+
+    publish();
+}
+
+void AsyncIO::draw(const FrameRow* rows)
+{
+    std::memcpy(slots[back], rows, sizeof(slots[back]));
+    publish();
+}
+
+// The renderer works out what changed against what it last presented, so
+// the emulator's dirty pixels are not needed
+void AsyncIO::draw(const FrameRow* rows, const FrameRow* dirty)
+{
+    draw(rows);
+}
+
+void AsyncIO::updateKeys()
+{
+    target.updateKeys();
+}
+
+void AsyncIO::updateKeys(unsigned long long cycle)
+{
+    target.updateKeys(cycle);
+}
+
+bool AsyncIO::isKeyPressed(unsigned char keyValue)
+{
+    return target.isKeyPressed(keyValue);
+}
+
+unsigned short AsyncIO::keyMask()
+{
+    return target.keyMask();
+}
+
+void AsyncIO::beep(bool on)
+{
+    target.beep(on);
+}
+
+unsigned long long AsyncIO::framesDropped() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void AsyncIO::publish()
+{
+    unsigned char previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+
+    back = previous & SLOT_MASK;
+    if(previous & FRESH)
+        dropped.fetch_add(1, std::memory_order_relaxed);
+
+    frameReady.notify_one();
+}
+
+void AsyncIO::render()
+{
+    FrameRow dirty[DISPLAY_LINES];
+    bool painted = false;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            frameReady.wait_for(guard, RENDER_POLL, [this] {
+                return stopping || (middle.load(std::memory_order_acquire) & FRESH);
+            });
+        }
+
+        if(!(middle.load(std::memory_order_acquire) & FRESH))
+        {
+            if(stopping)
+                return;
+            continue;
+        }
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & SLOT_MASK;
+
+        // Repaint what differs from the screen, everything the first time
+        for(int y = 0; y < DISPLAY_LINES; y++)
+        {
+            dirty[y] = painted ? shown[y] ^ slots[front][y] : ~(FrameRow)0;
+            shown[y] = slots[front][y];
+        }
+
+        target.draw(shown, dirty);
+        painted = true;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef _ASYNCIO_H
+#define _ASYNCIO_H
+
+#include "io.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+ * Presents frames from a render thread so a slow backend never stalls the
+ * emulation thread. Frames are handed over through a triple buffer: the
+ * emulator fills the back slot and swaps it with the middle one, the
+ * renderer swaps the middle slot with its front one whenever it is fresh.
+ * Neither side ever waits for the other, frames the renderer has not taken
+ * yet are replaced by newer ones. Input is forwarded on the caller's
+ * thread.
+ */
+class AsyncIO final : public IO
+{
+public:
+    /* Constructors, operators, and destructor */
+    explicit AsyncIO(IO& target);
+    AsyncIO(const AsyncIO& other) = delete;
+    AsyncIO& operator=(const AsyncIO& other) = delete;
+    ~AsyncIO();
+
+    /* Video */
+    virtual void draw(const unsigned char* gfx) override;
+    virtual void draw(const FrameRow* rows) override;
+    virtual void draw(const FrameRow* rows, const FrameRow* dirty) override;
+
+    /* Input */
+    virtual void updateKeys() override;
+    virtual void updateKeys(unsigned long long cycle) override;
+    virtual bool isKeyPressed(unsigned char keyValue) override;
+    virtual unsigned short keyMask() override;
+
+    /* Sound */
+    virtual void beep(bool on) override;
+
+    /* Instance methods */
+    unsigned long long framesDropped() const;
+private:
+    /* Auxiliary methods */
+    void publish();
+    void render();
+private:
+    IO& target;
+
+    /* Only touched by the emulation thread */
+    unsigned char back;
+
+    /* Slot index in the low bits, FRESH while the renderer has not taken it */
+    std::atomic<unsigned char> middle;
+    std::atomic<unsigned long long> dropped;
+    FrameRow slots[3][DISPLAY_LINES];
+
+    /* Only touched by the render thread */
+    unsigned char front;
+    FrameRow shown[DISPLAY_LINES];
+
+    /* Wakes the renderer, the emulation thread never takes the lock */
+    std::mutex lock;
+    std::condition_variable frameReady;
+    std::atomic<bool> stopping;
+
+    std::thread renderer;
+};
+
+#endif  // _ASYNCIO_H
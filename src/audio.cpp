@@ -0,0 +1,249 @@
+#include "audio.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#define TIMER_FREQUENCY 60         // beep() comes once per scheduler frame
+#define DRAIN_CHUNK 4096
+
+// Bounds the delay when a wakeup slips in before the other side waits
+#define AUDIO_POLL std::chrono::milliseconds(10)
+
+/////////////////////////////////////////////////////////////////////////
+
+SampleRing::SampleRing(std::size_t capacity)
+    : head(0), tail(0)
+{
+    std::size_t size = 1;
+
+    while(size < capacity)
+        size <<= 1;
+
+    buffer.resize(size);
+    mask = size - 1;
+}
+
+std::size_t SampleRing::write(const short* samples, std::size_t count)
+{
+    std::size_t position = head.load(std::memory_order_relaxed);
+
+    count = std::min(count, space());
+
+    // At most two pieces, the second one wrapped to the start
+    std::size_t offset = position & mask;
+    std::size_t first = std::min(count, buffer.size() - offset);
+    std::memcpy(&buffer[offset], samples, first * sizeof(short));
+    std::memcpy(&buffer[0], samples + first, (count - first) * sizeof(short));
+
+    // Publish the samples before the position that covers them
+    head.store(position + count, std::memory_order_release);
+
+    return count;
+}
+
+std::size_t SampleRing::read(short* samples, std::size_t count)
+{
+    std::size_t position = tail.load(std::memory_order_relaxed);
+
+    count = std::min(count, available());
+
+    std::size_t offset = position & mask;
+    std::size_t first = std::min(count, buffer.size() - offset);
+    std::memcpy(samples, &buffer[offset], first * sizeof(short));
+    std::memcpy(samples + first, &buffer[0], (count - first) * sizeof(short));
+
+    tail.store(position + count, std::memory_order_release);
+
+    return count;
+}
+
+std::size_t SampleRing::available() const
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+std::size_t SampleRing::space() const
+{
+    return buffer.size() - available();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+NullSink::NullSink()
+    : samples(0)
+{
+
+}
+
+void NullSink::write(const short* samples, std::size_t count)
+{
+    this->samples += count;
+}
+
+unsigned long long NullSink::samplesWritten() const
+{
+    return samples;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+WavSink::WavSink(const std::string& file, unsigned int sampleRate)
+    : out(file, std::ios::binary), sampleRate(sampleRate), samples(0)
+{
+    if(!out)
+        throw std::runtime_error("Could not open " + file);
+
+    // Sizes are patched in once the length is known
+    writeHeader();
+}
+
+WavSink::~WavSink()
+{
+    out.seekp(0);
+    writeHeader();
+}
+
+void WavSink::write(const short* samples, std::size_t count)
+{
+    out.write((const char *)samples, count * sizeof(short));
+    this->samples += count;
+}
+
+void WavSink::writeHeader()
+{
+    unsigned int dataSize = samples * sizeof(short);
+    unsigned int riffSize = 36 + dataSize;
+    unsigned int formatSize = 16;
+    unsigned short format = 1;              // PCM
+    unsigned short channels = 1;
+    unsigned int byteRate = sampleRate * sizeof(short);
+    unsigned short blockAlign = sizeof(short);
+    unsigned short bitsPerSample = 16;
+
+    out.write("RIFF", 4);
+    out.write((const char *)&riffSize, 4);
+    out.write("WAVEfmt ", 8);
+    out.write((const char *)&formatSize, 4);
+    out.write((const char *)&format, 2);
+    out.write((const char *)&channels, 2);
+    out.write((const char *)&sampleRate, 4);
+    out.write((const char *)&byteRate, 4);
+    out.write((const char *)&blockAlign, 2);
+    out.write((const char *)&bitsPerSample, 2);
+    out.write("data", 4);
+    out.write((const char *)&dataSize, 4);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+AudioIO::AudioIO(IO& target, AudioSink& sink, unsigned int sampleRate)
+    : target(target), sink(sink), sampleRate(sampleRate), ring(AUDIO_RING_SAMPLES), frames(0), phase(0), stopping(false)
+{
+    frame.reserve(sampleRate / TIMER_FREQUENCY + 1);
+
+    consumer = std::thread(&AudioIO::drain, this);
+}
+
+AudioIO::~AudioIO()
+{
+    // Whatever is still queued reaches the sink first
+    stopping = true;
+    samplesReady.notify_one();
+
+    consumer.join();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void AudioIO::draw(const unsigned char* gfx)
+{
+    target.draw(gfx);
+}
+
+void AudioIO::draw(const FrameRow* rows)
+{
+    target.draw(rows);
+}
+
+void AudioIO::draw(const FrameRow* rows, const FrameRow* dirty)
+{
+    target.draw(rows, dirty);
+}
+
+void AudioIO::updateKeys()
+{
+    target.updateKeys();
+}
+
+void AudioIO::updateKeys(unsigned long long cycle)
+{
+    target.updateKeys(cycle);
+}
+
+bool AudioIO::isKeyPressed(unsigned char keyValue)
+{
+    return target.isKeyPressed(keyValue);
+}
+
+unsigned short AudioIO::keyMask()
+{
+    return target.keyMask();
+}
+
+void AudioIO::beep(bool on)
+{
+    // Spread the rate evenly when it is not a multiple of the timer rate
+    std::size_t count = (frames + 1) * sampleRate / TIMER_FREQUENCY - frames * sampleRate / TIMER_FREQUENCY;
+    frames++;
+
+    frame.resize(count);
+    if(!on)
+        std::fill(frame.begin(), frame.end(), 0);
+    else
+        for(std::size_t i = 0; i < count; i++)
+            frame[i] = (((phase + i) * 2 * TONE_FREQUENCY / sampleRate) & 1) ? -TONE_AMPLITUDE : TONE_AMPLITUDE;
+
+    // Every tone starts on the same edge
+    phase = on ? phase + count : 0;
+
+    std::size_t written = ring.write(frame.data(), count);
+    samplesReady.notify_one();
+
+    // Only a sink slower than the emulator gets here, usually headless
+    while(written < count)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            spaceReady.wait_for(guard, AUDIO_POLL, [this] { return ring.space() > 0; });
+        }
+
+        written += ring.write(frame.data() + written, count - written);
+        samplesReady.notify_one();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void AudioIO::drain()
+{
+    short chunk[DRAIN_CHUNK];
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            samplesReady.wait_for(guard, AUDIO_POLL, [this] { return stopping || ring.available() > 0; });
+        }
+
+        std::size_t count = ring.read(chunk, DRAIN_CHUNK);
+
+        if(count)
+        {
+            spaceReady.notify_one();
+            sink.write(chunk, count);
+        }
+        else if(stopping)
+            return;
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef _AUDIO_H
+#define _AUDIO_H
+
+#include "io.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_SAMPLE_RATE 44100
+#define TONE_FREQUENCY 440
+#define TONE_AMPLITUDE 8000
+#define AUDIO_RING_SAMPLES (1 << 16)    // About a second and a half
+
+/* Single producer, single consumer queue of samples */
+class SampleRing
+{
+public:
+    /* Constructors */
+    explicit SampleRing(std::size_t capacity);     // Rounded up to a power of two
+
+    /* Instance methods */
+    std::size_t write(const short* samples, std::size_t count);
+    std::size_t read(short* samples, std::size_t count);
+    std::size_t available() const;
+    std::size_t space() const;
+private:
+    std::vector<short> buffer;
+    std::size_t mask;
+
+    /* Free running positions, each stored by one side only */
+    alignas(64) std::atomic<std::size_t> head;     // Producer
+    alignas(64) std::atomic<std::size_t> tail;     // Consumer
+};
+
+/* Where samples end up, 16-bit mono */
+class AudioSink
+{
+public:
+    virtual ~AudioSink() {}
+    virtual void write(const short* samples, std::size_t count) = 0;
+};
+
+/* Drops everything, for hosts without sound */
+class NullSink : public AudioSink
+{
+public:
+    NullSink();
+
+    virtual void write(const short* samples, std::size_t count) override;
+    unsigned long long samplesWritten() const;
+private:
+    unsigned long long samples;
+};
+
+/* PCM WAV file, the sizes in the header are filled in when it is closed */
+class WavSink : public AudioSink
+{
+public:
+    explicit WavSink(const std::string& file, unsigned int sampleRate = DEFAULT_SAMPLE_RATE);
+    ~WavSink();
+
+    virtual void write(const short* samples, std::size_t count) override;
+private:
+    void writeHeader();
+private:
+    std::ofstream out;
+    unsigned int sampleRate;
+    unsigned long long samples;
+};
+
+/*
+ * Plays the sound timer through another IO. Each beep() call covers one
+ * 60 Hz frame of guest time and appends that frame's square wave to a
+ * ring, a thread drains the ring into the sink. The samples follow the
+ * guest clock, so the stream has no gaps however fast the host runs; when
+ * the sink falls a whole ring behind the emulation thread waits for it
+ * rather than dropping sound.
+ */
+class AudioIO final : public IO
+{
+public:
+    /* Constructors, operators, and destructor */
+    AudioIO(IO& target, AudioSink& sink, unsigned int sampleRate = DEFAULT_SAMPLE_RATE);
+    AudioIO(const AudioIO& other) = delete;
+    AudioIO& operator=(const AudioIO& other) = delete;
+    ~AudioIO();
+
+    /* Video */
+    virtual void draw(const unsigned char* gfx) override;
+    virtual void draw(const FrameRow* rows) override;
+    virtual void draw(const FrameRow* rows, const FrameRow* dirty) override;
+
+    /* Input */
+    virtual void updateKeys() override;
+    virtual void updateKeys(unsigned long long cycle) override;
+    virtual bool isKeyPressed(unsigned char keyValue) override;
+    virtual unsigned short keyMask() override;
+
+    /* Sound */
+    virtual void beep(bool on) override;
+private:
+    /* Auxiliary methods */
+    void drain();
+private:
+    IO& target;
+    AudioSink& sink;
+    unsigned int sampleRate;
+    SampleRing ring;
+
+    /* Only touched by the emulation thread */
+    unsigned long long frames;
+    unsigned long long phase;           // Samples into the tone, kept across frames
+    std::vector<short> frame;
+
+    /* Wakes the other side, the lock is only held while checking */
+    std::mutex lock;
+    std::condition_variable samplesReady;
+    std::condition_variable spaceReady;
+    std::atomic<bool> stopping;
+
+    std::thread consumer;
+};
+
+#endif  // _AUDIO_H
@@ -0,0 +1,142 @@
+#include "batchrunner.h"
+#include "json.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_CYCLES 10000000
+
+static void printResult(const BatchJob& job, const BatchResult& result)
+{
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", result.frameHash);
+
+    std::cout << "{\"rom\": " << jsonString(job.rom) << ", \"script\": " << jsonString(job.script)
+              << ", \"quirks\": \"" << quirkProfileName(job.quirks) << "\"";
+
+    if(!job.capture.empty())
+        std::cout << ", \"capture\": " << jsonString(job.capture);
+
+    if(!result.error.empty())
+    {
+        std::cout << ", \"error\": " << jsonString(result.error) << "}" << std::endl;
+        return;
+    }
+
+    std::cout << ", \"cycles\": " << result.cycles
+              << ", \"frames\": " << result.frames
+              << ", \"frames_drawn\": " << result.framesDrawn
+              << ", \"frame_hash\": \"" << hash << "\"";
+
+    // Only when the program did something the hardware would not survive
+    if(result.faults)
+    {
+        std::snprintf(hash, sizeof(hash), "0x%03x", result.faultAddress);
+        std::cout << ", \"faults\": " << (int)result.faults << ", \"fault_address\": \"" << hash << "\"";
+    }
+
+    std::cout << ", \"seconds\": " << result.seconds << "}" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    BatchJob prototype = { "", "", 0, 0, ExecutionMode::Interpreter, 0, QuirkProfile::Default, "" };
+    unsigned int threads = std::thread::hardware_concurrency();
+    std::vector<std::string> roms, scripts;
+    std::vector<QuirkProfile> profiles;
+    std::string captureDirectory;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--cycles" && argument + 1 < argc)
+            prototype.cycleBudget = std::strtoull(argv[++argument], nullptr, 10);
+        else if(option == "--frames" && argument + 1 < argc)
+            prototype.frameBudget = std::strtoull(argv[++argument], nullptr, 10);
+        else if(option == "--threads" && argument + 1 < argc)
+            threads = std::strtoul(argv[++argument], nullptr, 10);
+        else if(option == "--script" && argument + 1 < argc)
+            scripts.push_back(argv[++argument]);
+        else if(option == "--list" && argument + 1 < argc)
+        {
+            std::ifstream list(argv[++argument]);
+            std::string line;
+
+            while(std::getline(list, line))
+                if(!line.empty())
+                    roms.push_back(line);
+        }
+        else if(option == "--jit")
+            prototype.mode = ExecutionMode::Recompiler;
+        else if(option == "--capture" && argument + 1 < argc)
+            captureDirectory = argv[++argument];
+        else if(option == "--seed" && argument + 1 < argc)
+            prototype.seed = std::strtoull(argv[++argument], nullptr, 0);
+        else if(option == "--quirks" && argument + 1 < argc && std::string(argv[argument + 1]) == "all")
+        {
+            argument++;
+            for(int i = 0; i < NUM_QUIRK_PROFILES; i++)
+                profiles.push_back((QuirkProfile)i);
+        }
+        else if(option == "--quirks" && argument + 1 < argc && parseQuirkProfile(argv[argument + 1], prototype.quirks))
+        {
+            argument++;
+            profiles.push_back(prototype.quirks);
+        }
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    for(; argument < argc; argument++)
+        roms.push_back(argv[argument]);
+
+    if(roms.empty())
+    {
+        std::cerr << "Usage: chip8batch [--cycles N] [--frames N] [--threads N] [--jit] [--seed N] "
+                     "[--quirks NAME|all] [--capture DIRECTORY] "
+                     "[--script input.txt]... [--list roms.txt] [program.ch8...]" << std::endl;
+        return 1;
+    }
+
+    if(!prototype.cycleBudget && !prototype.frameBudget)
+        prototype.cycleBudget = DEFAULT_CYCLES;
+    if(scripts.empty())
+        scripts.push_back("");
+    if(profiles.empty())
+        profiles.push_back(QuirkProfile::Default);
+
+    // Every program runs once per input script and quirk profile
+    std::vector<BatchJob> jobs;
+    for(const std::string& rom : roms)
+        for(const std::string& script : scripts)
+            for(QuirkProfile profile : profiles)
+            {
+                BatchJob job = prototype;
+                job.rom    = rom;
+                job.script = script;
+                job.quirks = profile;
+                if(!captureDirectory.empty())
+                    job.capture = captureDirectory + "/" + std::to_string(jobs.size()) + ".c8v";
+                jobs.push_back(job);
+            }
+
+    std::vector<BatchResult> results = BatchRunner(threads).run(jobs);
+
+    bool failed = false;
+    for(size_t i = 0; i < jobs.size(); i++)
+    {
+        printResult(jobs[i], results[i]);
+        failed |= !results[i].error.empty();
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+#include "batchrunner.h"
+#include "captureio.h"
+#include "scheduler.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+// Driven through the backend's own type, so the frame boundary calls it directly
+template<class Backend>
+static void runFrames(const BatchJob& job, CHIP8Emulator& emulator, Scheduler& scheduler, Backend& io, const std::vector<InputEvent>& events)
+{
+    size_t nextEvent = 0;
+
+    while((!job.cycleBudget || emulator.cycleCount() < job.cycleBudget) &&
+          (!job.frameBudget || scheduler.frameCount() < job.frameBudget))
+    {
+        // Input only changes between frames, like keys polled by the scheduler
+        for(; nextEvent < events.size() && events[nextEvent].cycle <= emulator.cycleCount(); nextEvent++)
+            io.setKey(events[nextEvent].key, events[nextEvent].pressed);
+
+        scheduler.runFrame(io);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// A job that throws fails alone, the exception must not reach the pool
+BatchResult BatchRunner::runJob(const BatchJob& job)
+{
+    BatchResult result = {};
+    std::vector<InputEvent> events;
+
+    try
+    {
+        if(!std::ifstream(job.rom))
+        {
+            result.error = "cannot open " + job.rom;
+            return result;
+        }
+        if(!job.script.empty())
+        {
+            if(!std::ifstream(job.script))
+            {
+                result.error = "cannot open " + job.script;
+                return result;
+            }
+            events = loadScript(job.script);
+        }
+
+        std::ofstream video;
+        if(!job.capture.empty())
+        {
+            video.open(job.capture, std::ios::binary);
+            if(!video)
+            {
+                result.error = "cannot open " + job.capture;
+                return result;
+            }
+        }
+
+        HeadlessIO headless;
+        std::unique_ptr<CaptureIO> capture(video.is_open() ? new CaptureIO(video) : nullptr);
+        HeadlessIOBase& io = capture ? (HeadlessIOBase&)*capture : headless;
+        CHIP8Emulator emulator(io);
+        Scheduler scheduler(emulator);
+
+        emulator.setExecutionMode(job.mode);
+        emulator.setQuirkProfile(job.quirks);
+        emulator.reset();
+        emulator.seed(job.seed);
+        emulator.load(job.rom);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if(capture)
+            runFrames(job, emulator, scheduler, *capture, events);
+        else
+            runFrames(job, emulator, scheduler, headless, events);
+
+        // A capture cut short by a full disk fails the job
+        if(capture)
+            capture->finish();
+
+        result.seconds     = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.cycles      = emulator.cycleCount();
+        result.frames      = scheduler.frameCount();
+        result.framesDrawn = io.framesDrawn();
+        result.frameHash   = emulator.frameHash();
+        result.faults      = emulator.faults();
+        result.faultAddress = emulator.faultAddress();
+    }
+    catch(const std::exception& error)
+    {
+        result = BatchResult();
+        result.error = error.what();
+    }
+
+    return result;
+}
+
+std::vector<InputEvent> BatchRunner::loadScript(const std::string& file)
+{
+    // One event per line: <cycle> <key in hex> <1 for down, 0 for up>
+    std::ifstream script(file);
+    std::vector<InputEvent> events;
+    std::string line;
+
+    while(std::getline(script, line))
+    {
+        std::istringstream fields(line);
+        InputEvent event;
+        unsigned int key, pressed;
+
+        if(line.empty() || line[0] == '#')
+            continue;
+        if(!(fields >> event.cycle >> std::hex >> key >> std::dec >> pressed))
+            continue;
+
+        event.key     = key & 0xf;
+        event.pressed = pressed;
+        events.push_back(event);
+    }
+
+    return events;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+BatchRunner::BatchRunner(unsigned int threads)
+    : pool(threads)
+{
+
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob>& jobs)
+{
+    std::vector<BatchResult> results(jobs.size());
+
+    // Every task owns its result slot, no locking needed
+    for(size_t i = 0; i < jobs.size(); i++)
+        pool.submit([&jobs, &results, i] { results[i] = runJob(jobs[i]); });
+    pool.wait();
+
+    return results;
+}
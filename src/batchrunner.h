@@ -0,0 +1,56 @@
+#ifndef _BATCHRUNNER_H
+#define _BATCHRUNNER_H
+
+#include "emulator.h"
+#include "threadpool.h"
+#include <string>
+#include <vector>
+
+struct InputEvent
+{
+    unsigned long long cycle;
+    unsigned char key;
+    bool pressed;
+};
+
+struct BatchJob
+{
+    std::string rom;
+    std::string script;                 // Empty for no input
+    unsigned long long cycleBudget;     // 0 for no limit
+    unsigned long long frameBudget;     // 0 for no limit
+    ExecutionMode mode;
+    unsigned long long seed;            // Random generator seed, runs are reproducible
+    QuirkProfile quirks;
+    std::string capture;                // Frame capture file, empty for none
+};
+
+struct BatchResult
+{
+    unsigned long long cycles;
+    unsigned long long frames;          // 60 Hz guest frames
+    unsigned long long framesDrawn;     // Frames the program presented
+    unsigned long long frameHash;
+    unsigned char faults;               // GuestFault bits, 0 when the program behaved
+    SpecialRegister faultAddress;
+    double seconds;
+    std::string error;
+};
+
+class BatchRunner
+{
+public:
+    /* Static methods */
+    static BatchResult runJob(const BatchJob& job);
+    static std::vector<InputEvent> loadScript(const std::string& file);
+
+    /* Constructors */
+    explicit BatchRunner(unsigned int threads);
+
+    /* Instance methods */
+    std::vector<BatchResult> run(const std::vector<BatchJob>& jobs);
+private:
+    ThreadPool pool;
+};
+
+#endif  // _BATCHRUNNER_H
@@ -0,0 +1,213 @@
+#include "audio.h"
+#include "emulator.h"
+#include "headlessio.h"
+#include "json.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define DEFAULT_CYCLES 10000000
+#define PROFILE_CYCLES 1000000
+#define NUM_CLASSES 16
+
+static const char* classNames[NUM_CLASSES] = {
+    "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XYN", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EXNN", "FXNN"
+};
+
+struct BenchResult
+{
+    std::string rom;
+    unsigned long long instructions;        // Actually run
+    unsigned long long skippedCycles;       // Idle loops and key waits fast-forwarded
+    double seconds;
+    unsigned long long frames;
+    unsigned long long rewindFrames;
+    unsigned long long rewindBytes;
+    unsigned long long audioSamples;
+    double classNanoseconds[NUM_CLASSES];
+    unsigned long long classCounts[NUM_CLASSES];
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// Through the backend's own type, headless frames cost no virtual calls
+template<class Backend>
+static void runBudget(Scheduler& scheduler, CHIP8Emulator& emulator, Backend& io, unsigned long long cycles)
+{
+    while(emulator.cycleCount() < cycles)
+        scheduler.runFrame(io);
+}
+
+// Run the whole budget the way the scheduler does, minus the sleeping
+static void measureThroughput(BenchResult& result, const std::string& rom, unsigned long long cycles, ExecutionMode mode, unsigned int instructionsPerSecond, bool rewind, bool sound)
+{
+    HeadlessIO io;
+    NullSink sink;
+    std::unique_ptr<AudioIO> audio(sound ? new AudioIO(io, sink) : nullptr);
+    CHIP8Emulator emulator(audio ? (IO&)*audio : io);
+    Scheduler scheduler(emulator, instructionsPerSecond);
+    RewindBuffer history;
+
+    if(rewind)
+        scheduler.setRewindBuffer(&history);
+
+    emulator.setExecutionMode(mode);
+    emulator.reset();
+    emulator.load(rom);
+
+    Clock::time_point start = Clock::now();
+    if(audio)
+        runBudget(scheduler, emulator, *audio, cycles);
+    else
+        runBudget(scheduler, emulator, io, cycles);
+    // Queued samples count, the sink has to keep up
+    audio.reset();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    result.audioSamples = sink.samplesWritten();
+    result.instructions = emulator.cycleCount() - emulator.skippedCycleCount();
+    result.skippedCycles = emulator.skippedCycleCount();
+    result.frames = io.framesDrawn();
+    result.rewindFrames = history.size();
+    result.rewindBytes = history.byteSize();
+}
+
+// Step one instruction at a time and time each one, minus the cost of
+// reading the clock
+static void measureClasses(BenchResult& result, const std::string& rom, unsigned long long cycles)
+{
+    HeadlessIO io;
+    CHIP8Emulator emulator(io);
+    double total[NUM_CLASSES] = {};
+
+    emulator.reset();
+    emulator.load(rom);
+
+    Clock::time_point calibration = Clock::now();
+    for(int i = 0; i < 1000; i++)
+        Clock::now();
+    double overhead = std::chrono::duration<double, std::nano>(Clock::now() - calibration).count() / 1000;
+
+    for(unsigned long long i = 0; i < cycles; i++)
+    {
+        int opcodeClass = emulator.nextInstruction() >> 12;
+
+        Clock::time_point start = Clock::now();
+        emulator.runTick();
+        total[opcodeClass] += std::chrono::duration<double, std::nano>(Clock::now() - start).count() - overhead;
+        result.classCounts[opcodeClass]++;
+
+        if((i + 1) % (DEFAULT_INSTRUCTIONS_PER_SECOND / TIMER_FREQUENCY) == 0)
+            emulator.updateTimers();
+    }
+
+    for(int i = 0; i < NUM_CLASSES; i++)
+        result.classNanoseconds[i] = result.classCounts[i] ? std::max(total[i], 0.0) / result.classCounts[i] : 0;
+}
+
+static void printJSON(const std::vector<BenchResult>& results, unsigned long long cycles, ExecutionMode mode)
+{
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "{\n  \"cycles\": " << cycles << ",\n  \"mode\": \""
+              << (mode == ExecutionMode::Interpreter ? "interpreter" : "recompiler") << "\",\n  \"roms\": [";
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+
+        std::cout << (i ? "," : "") << "\n    {\n"
+                  << "      \"rom\": " << jsonString(result.rom) << ",\n"
+                  << "      \"instructions\": " << result.instructions << ",\n"
+                  << "      \"seconds\": " << result.seconds << ",\n"
+                  << "      \"instructions_per_second\": " << result.instructions / result.seconds << ",\n"
+                  << "      \"skipped_cycles\": " << result.skippedCycles << ",\n"
+                  << "      \"frames\": " << result.frames << ",\n";
+        if(result.rewindFrames)
+            std::cout << "      \"rewind_frames\": " << result.rewindFrames << ",\n"
+                      << "      \"rewind_bytes\": " << result.rewindBytes << ",\n";
+        if(result.audioSamples)
+            std::cout << "      \"audio_samples\": " << result.audioSamples << ",\n";
+        std::cout << "      \"ns_per_opcode_class\": {";
+
+        bool first = true;
+        for(int c = 0; c < NUM_CLASSES; c++)
+        {
+            if(!result.classCounts[c])
+                continue;
+            std::cout << (first ? "" : ",") << "\n        \"" << classNames[c] << "\": " << result.classNanoseconds[c];
+            first = false;
+        }
+        std::cout << "\n      }\n    }";
+    }
+
+    std::cout << "\n  ]\n}" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long cycles = DEFAULT_CYCLES;
+    ExecutionMode mode = ExecutionMode::Interpreter;
+    unsigned int instructionsPerSecond = DEFAULT_INSTRUCTIONS_PER_SECOND;
+    bool rewind = false;
+    bool sound = false;
+    std::vector<BenchResult> results;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--cycles" && argument + 1 < argc)
+            cycles = std::strtoull(argv[++argument], nullptr, 10);
+        else if(option == "--jit")
+            mode = ExecutionMode::Recompiler;
+        else if(option == "--ips" && argument + 1 < argc && std::strtoul(argv[argument + 1], nullptr, 10) > 0)
+            instructionsPerSecond = std::strtoul(argv[++argument], nullptr, 10);
+        else if(option == "--rewind")
+            rewind = true;
+        else if(option == "--audio")
+            sound = true;
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument >= argc)
+    {
+        std::cerr << "Usage: chip8bench [--cycles N] [--ips N] [--jit] [--rewind] [--audio] program.ch8..." << std::endl;
+        return 1;
+    }
+
+    for(int rom = argument; rom < argc; rom++)
+    {
+        if(!std::ifstream(argv[rom]))
+        {
+            std::cerr << "Could not open " << argv[rom] << std::endl;
+            return 1;
+        }
+    }
+
+    for(; argument < argc; argument++)
+    {
+        BenchResult result = {};
+
+        result.rom = argv[argument];
+        measureThroughput(result, result.rom, cycles, mode, instructionsPerSecond, rewind, sound);
+        measureClasses(result, result.rom, std::min(cycles, (unsigned long long)PROFILE_CYCLES));
+        results.push_back(result);
+    }
+
+    printJSON(results, cycles, mode);
+
+    return 0;
+}
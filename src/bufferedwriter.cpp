@@ -0,0 +1,94 @@
+#include "bufferedwriter.h"
+#include <utility>
+
+BufferedWriter::BufferedWriter(std::ostream& out, std::size_t bufferSize)
+    : out(out), bufferSize(bufferSize ? bufferSize : 1), writing(false), stopping(false), failed(false)
+{
+    buffer.reserve(this->bufferSize);
+    writer = std::thread(&BufferedWriter::work, this);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    flush();
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    bufferReady.notify_one();
+
+    writer.join();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void BufferedWriter::write(const void* data, std::size_t size)
+{
+    if(buffer.size() + size > bufferSize && !buffer.empty())
+        handOff();
+
+    const char* bytes = (const char *)data;
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+// False once any write failed, a full disk must not pass for a whole file
+bool BufferedWriter::flush()
+{
+    if(!buffer.empty())
+        handOff();
+
+    std::unique_lock<std::mutex> guard(lock);
+    allWritten.wait(guard, [this] { return full.empty() && !writing; });
+    out.flush();
+
+    return !failed && out;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void BufferedWriter::handOff()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        full.push_back(std::move(buffer));
+
+        // Reuse a drained buffer so steady state does not allocate
+        buffer.clear();
+        if(!spare.empty())
+        {
+            buffer.swap(spare.back());
+            spare.pop_back();
+        }
+    }
+    bufferReady.notify_one();
+
+    buffer.reserve(bufferSize);
+}
+
+void BufferedWriter::work()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    while(true)
+    {
+        bufferReady.wait(guard, [this] { return stopping || !full.empty(); });
+        if(full.empty())
+            return;
+
+        std::vector<char> next = std::move(full.front());
+        full.pop_front();
+        writing = true;
+
+        guard.unlock();
+        bool written = !failed && out.write(next.data(), next.size());
+        next.clear();
+        guard.lock();
+
+        writing = false;
+        failed |= !written;
+        spare.push_back(std::move(next));
+        if(full.empty())
+            allWritten.notify_all();
+    }
+}
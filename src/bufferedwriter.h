@@ -0,0 +1,58 @@
+#ifndef _BUFFEREDWRITER_H
+#define _BUFFEREDWRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_WRITE_BUFFER (1 << 16)
+
+/*
+ * Collects small writes in memory and hands full buffers to a background
+ * thread, so the emulation thread never waits on the disk. A failed write
+ * cannot be reported where it was made, flush() tells whether all of them
+ * reached the stream.
+ */
+class BufferedWriter
+{
+public:
+    /* Constructors, operators, and destructor */
+    explicit BufferedWriter(std::ostream& out, std::size_t bufferSize = DEFAULT_WRITE_BUFFER);
+    BufferedWriter(const BufferedWriter& other) = delete;
+    BufferedWriter& operator=(const BufferedWriter& other) = delete;
+    ~BufferedWriter();
+
+    /* Instance methods */
+    void write(const void* data, std::size_t size);
+    bool flush();
+private:
+    /* Auxiliary methods */
+    void handOff();
+    void work();
+private:
+    std::ostream& out;
+    std::size_t bufferSize;
+
+    /* Filled by the caller, only touched by its thread */
+    std::vector<char> buffer;
+
+    /* Shared with the writer thread */
+    std::mutex lock;
+    std::condition_variable bufferReady;
+    std::condition_variable allWritten;
+    std::deque<std::vector<char>> full;
+    std::vector<std::vector<char>> spare;
+    bool writing;
+    bool stopping;
+
+    /* A write to out failed, everything after it is dropped */
+    bool failed;
+
+    std::thread writer;
+};
+
+#endif  // _BUFFEREDWRITER_H
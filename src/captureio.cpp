@@ -0,0 +1,232 @@
+#include "captureio.h"
+#include <cstring>
+#include <stdexcept>
+
+#define CAPTURE_MAGIC "C8VD"
+#define CAPTURE_VERSION 1
+#define FRAME_BYTES (DISPLAY_LINES * sizeof(FrameRow))
+#define MAX_RUN 128
+#define MAX_PACKED (FRAME_BYTES + (FRAME_BYTES + MAX_RUN - 1) / MAX_RUN)    // Everything literal
+
+// Rows go out as little-endian words whatever the host is
+static void rowsToBytes(const FrameRow* rows, unsigned char* bytes)
+{
+    for(int y = 0; y < DISPLAY_LINES; y++)
+        for(unsigned int i = 0; i < sizeof(FrameRow); i++)
+            bytes[y * sizeof(FrameRow) + i] = (rows[y] >> (i * 8)) & 0xff;
+}
+
+static void bytesToRows(const unsigned char* bytes, FrameRow* rows)
+{
+    for(int y = 0; y < DISPLAY_LINES; y++)
+    {
+        rows[y] = 0;
+        for(unsigned int i = 0; i < sizeof(FrameRow); i++)
+            rows[y] |= (FrameRow)bytes[y * sizeof(FrameRow) + i] << (i * 8);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+enum CaptureRecordType
+{
+    RECORD_KEYFRAME = 'K',
+    RECORD_DELTA    = 'D'
+};
+
+// Runs of two or more become a run, anything else is copied as literals
+static std::size_t pack(const unsigned char* data, std::size_t size, unsigned char* out)
+{
+    std::size_t length = 0;
+    std::size_t i = 0;
+
+    while(i < size)
+    {
+        std::size_t run = 1;
+        while(i + run < size && run < MAX_RUN && data[i + run] == data[i])
+            run++;
+
+        if(run >= 2)
+        {
+            out[length++] = 257 - run;
+            out[length++] = data[i];
+            i += run;
+            continue;
+        }
+
+        // Literals stop where a run of three starts, shorter runs cost more split out
+        std::size_t start = i;
+        while(i < size && i - start < MAX_RUN && !(i + 2 < size && data[i] == data[i + 1] && data[i] == data[i + 2]))
+            i++;
+
+        out[length++] = i - start - 1;
+        std::memcpy(out + length, data + start, i - start);
+        length += i - start;
+    }
+
+    return length;
+}
+
+static bool unpack(const unsigned char* data, std::size_t size, unsigned char* out, std::size_t length)
+{
+    std::size_t position = 0;
+    std::size_t i = 0;
+
+    while(i < size)
+    {
+        unsigned char control = data[i++];
+
+        if(control < 128)
+        {
+            std::size_t count = control + 1;
+            if(i + count > size || position + count > length)
+                return false;
+
+            std::memcpy(out + position, data + i, count);
+            i += count;
+            position += count;
+        }
+        else if(control > 128)
+        {
+            std::size_t count = 257 - control;
+            if(i >= size || position + count > length)
+                return false;
+
+            std::memset(out + position, data[i++], count);
+            position += count;
+        }
+    }
+
+    return position == length;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+CaptureIO::CaptureIO(std::ostream& out, unsigned int keyframeInterval)
+    : writer(out), keyframeInterval(keyframeInterval ? keyframeInterval : 1), bytes(0), previous{}
+{
+    unsigned short fields[4] = { CAPTURE_VERSION, DISPLAY_COLUMNS, DISPLAY_LINES, (unsigned short)this->keyframeInterval };
+    unsigned char header[8];
+
+    for(int i = 0; i < 4; i++)
+    {
+        header[i * 2]     = fields[i] & 0xff;
+        header[i * 2 + 1] = fields[i] >> 8;
+    }
+
+    writer.write(CAPTURE_MAGIC, 4);
+    writer.write(header, sizeof(header));
+    bytes = 4 + sizeof(header);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void CaptureIO::draw(const unsigned char* gfx)
+{
+    HeadlessIOBase::draw(gfx);
+    capture();
+}
+
+void CaptureIO::draw(const FrameRow* rows)
+{
+    HeadlessIOBase::draw(rows);
+    capture();
+}
+
+void CaptureIO::finish()
+{
+    if(!writer.flush())
+        throw std::runtime_error("Could not write the frame capture");
+}
+
+unsigned long long CaptureIO::bytesWritten() const
+{
+    return bytes;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void CaptureIO::capture()
+{
+    const FrameRow* rows = lastFrame();
+    bool keyframe = (framesDrawn() - 1) % keyframeInterval == 0;
+    FrameRow delta[DISPLAY_LINES];
+    unsigned char deltaBytes[FRAME_BYTES];
+    unsigned char record[3 + MAX_PACKED];
+
+    // Most frames change a sprite or two, the delta is nearly all zeros
+    for(int y = 0; y < DISPLAY_LINES; y++)
+        delta[y] = keyframe ? rows[y] : rows[y] ^ previous[y];
+    std::memcpy(previous, rows, sizeof(previous));
+
+    rowsToBytes(delta, deltaBytes);
+    std::size_t size = pack(deltaBytes, FRAME_BYTES, record + 3);
+    record[0] = keyframe ? RECORD_KEYFRAME : RECORD_DELTA;
+    record[1] = size & 0xff;
+    record[2] = size >> 8;
+
+    writer.write(record, 3 + size);
+    bytes += 3 + size;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+CaptureReader::CaptureReader(std::istream& in)
+    : in(in), interval(0), frame{}
+{
+    char magic[4];
+    unsigned char bytes[8];
+    unsigned short header[4] = {};
+
+    in.read(magic, 4);
+    in.read((char *)bytes, sizeof(bytes));
+    for(int i = 0; i < 4; i++)
+        header[i] = bytes[i * 2] | (bytes[i * 2 + 1] << 8);
+    if(!in || std::memcmp(magic, CAPTURE_MAGIC, 4) != 0)
+        throw std::runtime_error("Not a frame capture");
+    if(header[0] != CAPTURE_VERSION || header[1] != DISPLAY_COLUMNS || header[2] != DISPLAY_LINES)
+        throw std::runtime_error("Frame capture was written by an incompatible version");
+
+    interval = header[3];
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool CaptureReader::next(FrameRow* rows)
+{
+    unsigned char header[3];
+    unsigned char deltaBytes[FRAME_BYTES];
+    FrameRow delta[DISPLAY_LINES];
+
+    if(!in.read((char *)header, sizeof(header)))
+        return false;
+
+    packed.resize(header[1] | (header[2] << 8));
+    if(!in.read((char *)packed.data(), packed.size()))
+        throw std::runtime_error("Frame capture is truncated");
+    if(!unpack(packed.data(), packed.size(), deltaBytes, FRAME_BYTES))
+        throw std::runtime_error("Corrupt frame capture");
+    bytesToRows(deltaBytes, delta);
+
+    switch(header[0])
+    {
+    case RECORD_KEYFRAME:
+        std::memcpy(frame, delta, sizeof(frame));
+        break;
+    case RECORD_DELTA:
+        for(int y = 0; y < DISPLAY_LINES; y++)
+            frame[y] ^= delta[y];
+        break;
+    default:
+        throw std::runtime_error("Corrupt frame capture");
+    }
+
+    std::memcpy(rows, frame, sizeof(frame));
+
+    return true;
+}
+
+unsigned int CaptureReader::keyframeInterval() const
+{
+    return interval;
+}
@@ -0,0 +1,68 @@
+#ifndef _CAPTUREIO_H
+#define _CAPTUREIO_H
+
+#include "bufferedwriter.h"
+#include "headlessio.h"
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/*
+ * Capture layout, multi-byte fields are little endian:
+ *
+ *   "C8VD" <version:16> <columns:16> <lines:16> <keyframe interval:16>
+ *
+ * followed by one record per presented frame:
+ *
+ *   'K' <size:16> <packed frame>     Keyframe
+ *   'D' <size:16> <packed delta>     XOR against the previous frame
+ *
+ * A frame is the display rows as 64-bit words, bit x of a row is column x.
+ * It is packed with PackBits: a control byte below 128 is followed by that
+ * many plus one literal bytes, a control byte c above 128 repeats the next
+ * byte 257 - c times.
+ */
+
+#define DEFAULT_CAPTURE_KEYFRAMES 60
+
+class CaptureIO final : public HeadlessIOBase
+{
+public:
+    /* Constructors */
+    explicit CaptureIO(std::ostream& out, unsigned int keyframeInterval = DEFAULT_CAPTURE_KEYFRAMES);
+
+    /* Video, the dirty pixel variant ends up in the packed one */
+    using HeadlessIOBase::draw;
+    virtual void draw(const unsigned char* gfx) override;
+    virtual void draw(const FrameRow* rows) override;
+
+    /* Instance methods */
+    void finish();
+    unsigned long long bytesWritten() const;
+private:
+    /* Auxiliary methods */
+    void capture();
+private:
+    BufferedWriter writer;
+    unsigned int keyframeInterval;
+    unsigned long long bytes;
+    FrameRow previous[DISPLAY_LINES];
+};
+
+class CaptureReader
+{
+public:
+    /* Constructors */
+    explicit CaptureReader(std::istream& in);
+
+    /* Instance methods */
+    bool next(FrameRow* rows);
+    unsigned int keyframeInterval() const;
+private:
+    std::istream& in;
+    unsigned int interval;
+    FrameRow frame[DISPLAY_LINES];
+    std::vector<unsigned char> packed;
+};
+
+#endif  // _CAPTUREIO_H
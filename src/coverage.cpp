@@ -0,0 +1,23 @@
+#include "coverage.h"
+#include <cstring>
+
+/////////////////////////////////////////////////////////////////////////
+
+Coverage::Coverage()
+    : hits(), previous(0)
+{
+
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void Coverage::clear()
+{
+    std::memset(hits, 0, sizeof(hits));
+    previous = 0;
+}
+
+const unsigned char* Coverage::map() const
+{
+    return hits;
+}
@@ -0,0 +1,44 @@
+#ifndef _COVERAGE_H
+#define _COVERAGE_H
+
+#include "emulator.h"
+#include <cstddef>
+
+#define COVERAGE_MAP_SIZE (1 << 14)
+
+/*
+ * Control flow edges seen by the emulator, for guiding the fuzzer. An edge
+ * is the previous block, the block entered and the instruction that ends
+ * it, so code rewritten in place counts as new. Edges are hashed into a map
+ * of hit counters the way AFL does it, collisions are rare at this size.
+ */
+class Coverage
+{
+public:
+    /* Constructors */
+    Coverage();
+
+    /* Instance methods */
+    void visit(SpecialRegister address, unsigned short terminator);
+    void clear();
+    const unsigned char* map() const;
+private:
+    unsigned char hits[COVERAGE_MAP_SIZE];
+    unsigned int previous;
+};
+
+// Called for every block, so it stays inline
+inline void Coverage::visit(SpecialRegister address, unsigned short terminator)
+{
+    unsigned int location = (address * 0x9e3779b1u) ^ (terminator * 0x85ebca6bu);
+    unsigned int edge = (location ^ previous) & (COVERAGE_MAP_SIZE - 1);
+
+    // Saturate instead of wrapping back to 0, which would look unvisited
+    if(hits[edge] != 0xff)
+        hits[edge]++;
+
+    // Shifted so A -> B and B -> A are different edges
+    previous = location >> 1;
+}
+
+#endif  // _COVERAGE_H
@@ -0,0 +1,465 @@
+#include "debugger.h"
+#include "headlessio.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#define DEFAULT_CONTINUE_FRAMES 3600    // A minute of guest time
+#define DISASSEMBLY_LINES 10
+
+static const char* help =
+    "break ADDRESS|* [if VX|I == != < <= > >= VALUE]   stop before ADDRESS, * for anywhere\n"
+    "watch ADDRESS [LENGTH] [r|w|rw]                   stop after a read or write through I\n"
+    "delete [ID]                                       remove one or every stop\n"
+    "list                                              show breakpoints and watchpoints\n"
+    "step [N]                                          run N instructions\n"
+    "continue [FRAMES]                                 run until a stop, at most FRAMES frames\n"
+    "regs                                              show registers, timers and the stack\n"
+    "disasm [ADDRESS] [COUNT]                          disassemble, around PC by default\n"
+    "mem ADDRESS [LENGTH]                              dump memory\n"
+    "display                                           show the screen\n"
+    "key KEY 1|0                                       press or release a key\n"
+    "quit\n";
+
+/*
+ * A headless machine that can stop anywhere in a frame. Frames end at the
+ * same cycles the scheduler would end them, so a session reaches the same
+ * states as a batch run with the same inputs.
+ */
+class Session
+{
+public:
+    Session(unsigned int instructionsPerSecond)
+        : emulator(io), debugger(emulator), instructionsPerSecond(instructionsPerSecond), frames(0)
+    {
+
+    }
+
+    StopReason run(unsigned long long frameBudget)
+    {
+        unsigned long long last = frames + frameBudget;
+
+        while(frames < last)
+        {
+            if(emulator.cycleCount() >= sliceEnd())
+            {
+                endFrame();
+                continue;
+            }
+
+            StopReason reason = emulator.runFor(sliceEnd() - emulator.cycleCount());
+            if(reason == StopReason::Breakpoint)
+                return reason;
+        }
+
+        return StopReason::BudgetExhausted;
+    }
+
+    // One instruction whatever the breakpoints say, watchpoints still report
+    bool step()
+    {
+        if(emulator.cycleCount() >= sliceEnd())
+            endFrame();
+
+        emulator.runTick();
+
+        // Polled keys come at the end of the frame, let its time pass
+        if(emulator.machineState().waitingForKey)
+            emulator.runFor(sliceEnd() - emulator.cycleCount());
+
+        return debugger.hit();
+    }
+
+    unsigned long long frameCount() const
+    {
+        return frames;
+    }
+public:
+    HeadlessIO io;
+    CHIP8Emulator emulator;
+    Debugger debugger;
+private:
+    unsigned long long sliceEnd() const
+    {
+        return (frames + 1) * instructionsPerSecond / TIMER_FREQUENCY;
+    }
+
+    void endFrame()
+    {
+        frames++;
+        emulator.updateTimers(io);
+        emulator.updateKeys(io);
+        if(emulator.hasNewFrame())
+            emulator.drawFrame(io);
+    }
+private:
+    unsigned int instructionsPerSecond;
+    unsigned long long frames;
+};
+
+static unsigned int parseNumber(const std::string& text)
+{
+    char* end;
+    unsigned long value = std::strtoul(text.c_str(), &end, 0);
+
+    if(text.empty() || *end)
+        throw std::runtime_error("Not a number: " + text);
+
+    return value;
+}
+
+static unsigned char parseRegister(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), ::toupper);
+
+    if(text == "I")
+        return REGISTER_I;
+    if(text.size() == 2 && text[0] == 'V' && std::isxdigit((unsigned char)text[1]))
+        return std::stoi(text.substr(1), nullptr, 16);
+
+    throw std::runtime_error("Not a register: " + text);
+}
+
+static std::string hex(unsigned int value, int digits)
+{
+    char text[16];
+    std::snprintf(text, sizeof(text), "0x%0*x", digits, value);
+
+    return text;
+}
+
+static void printInstruction(const Session& session, SpecialRegister address)
+{
+    const MachineState& state = session.emulator.machineState();
+    unsigned short instruction = state.mem[address % MEMORY_SIZE] << 8 | state.mem[(address + 1) % MEMORY_SIZE];
+    char line[64];
+
+    bool breakpoint = false;
+    for(const auto& entry : session.debugger.breakpoints())
+        breakpoint |= entry.second.address == address;
+
+    std::snprintf(line, sizeof(line), "%s%c 0x%03x: %04x  ", address == state.PC ? "=>" : "  ", breakpoint ? '*' : ' ',
+                  address, instruction);
+    std::cout << line << Debugger::disassemble(instruction) << std::endl;
+}
+
+static void printStop(const Session& session, StopReason reason, unsigned long long frames)
+{
+    const DebugStop& stop = session.debugger.lastStop();
+
+    if(reason != StopReason::Breakpoint)
+    {
+        std::cout << "Ran " << frames << " frames" << std::endl;
+        return;
+    }
+
+    if(session.debugger.watchpoints().count(stop.id))
+        std::cout << "Watchpoint " << stop.id << ": " << (stop.write ? "write " : "read ") << hex(stop.address, 3)
+                  << " length " << stop.length << " by " << hex(stop.pc, 3) << std::endl;
+    else
+        std::cout << "Breakpoint " << stop.id << " at " << hex(stop.pc, 3) << std::endl;
+
+    printInstruction(session, session.emulator.machineState().PC);
+}
+
+static void printRegisters(const Session& session)
+{
+    const MachineState& state = session.emulator.machineState();
+
+    for(int i = 0; i < NUM_GENERAL_REGISTERS; i++)
+        std::cout << "V" << "0123456789ABCDEF"[i] << "=" << hex(state.V[i], 2) << (i % 8 == 7 ? "\n" : " ");
+
+    std::cout << "I=" << hex(state.I, 3) << " PC=" << hex(state.PC, 3) << " DT=" << (int)state.delayTimer
+              << " ST=" << (int)state.soundTimer << " keys=" << hex(state.keys, 4) << "\n"
+              << "cycle " << state.cycles << ", frame " << session.frameCount() << "\n"
+              << "stack:";
+    for(int i = 0; i < state.SP && i < STACK_LEVEL; i++)
+        std::cout << " " << hex(state.stack[i], 3);
+    std::cout << std::endl;
+}
+
+static void printMemory(const Session& session, SpecialRegister address, unsigned int length)
+{
+    const MachineState& state = session.emulator.machineState();
+
+    for(unsigned int offset = 0; offset < length; offset += 16)
+    {
+        std::cout << hex((address + offset) % MEMORY_SIZE, 3) << ":";
+        for(unsigned int i = offset; i < length && i < offset + 16; i++)
+        {
+            char byte[4];
+            std::snprintf(byte, sizeof(byte), " %02x", state.mem[(address + i) % MEMORY_SIZE]);
+            std::cout << byte;
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::flush;
+}
+
+static void printDisplay(const Session& session)
+{
+    const MachineState& state = session.emulator.machineState();
+
+    for(int y = 0; y < DISPLAY_LINES; y++)
+    {
+        std::string line(DISPLAY_COLUMNS, '.');
+
+        for(int x = 0; x < DISPLAY_COLUMNS; x++)
+            if(state.gfx[y] >> x & 1)
+                line[x] = '#';
+        std::cout << line << "\n";
+    }
+    std::cout << std::flush;
+}
+
+static void addBreakpoint(Session& session, std::istringstream& arguments)
+{
+    Breakpoint breakpoint = { ANY_ADDRESS, 0, Comparison::Always, 0 };
+    std::string address, keyword, operand, comparison, value;
+
+    arguments >> address;
+    if(address != "*")
+        breakpoint.address = parseNumber(address) % MEMORY_SIZE;
+
+    if(arguments >> keyword)
+    {
+        if(keyword != "if" || !(arguments >> operand >> comparison >> value) ||
+           !Debugger::parseComparison(comparison, breakpoint.comparison))
+            throw std::runtime_error("Expected: if VX|I COMPARISON VALUE");
+
+        breakpoint.operand = parseRegister(operand);
+        breakpoint.value = parseNumber(value);
+    }
+    else if(breakpoint.address == ANY_ADDRESS)
+        throw std::runtime_error("A breakpoint anywhere needs a condition");
+
+    std::cout << "Breakpoint " << session.debugger.addBreakpoint(breakpoint) << std::endl;
+}
+
+static void addWatchpoint(Session& session, std::istringstream& arguments)
+{
+    Watchpoint watchpoint = { 0, 1, true, true };
+    std::string address, length, access;
+
+    if(!(arguments >> address))
+        throw std::runtime_error("Expected: watch ADDRESS [LENGTH] [r|w|rw]");
+    watchpoint.address = parseNumber(address) % MEMORY_SIZE;
+
+    if(arguments >> length)
+    {
+        if(length == "r" || length == "w" || length == "rw")
+            access = length;
+        else
+        {
+            watchpoint.length = std::min(parseNumber(length), (unsigned int)MEMORY_SIZE);
+            arguments >> access;
+        }
+    }
+    if(!access.empty())
+    {
+        watchpoint.read  = access.find('r') != std::string::npos;
+        watchpoint.write = access.find('w') != std::string::npos;
+    }
+
+    std::cout << "Watchpoint " << session.debugger.addWatchpoint(watchpoint) << std::endl;
+}
+
+static void listStops(const Session& session)
+{
+    for(const auto& entry : session.debugger.breakpoints())
+    {
+        const Breakpoint& breakpoint = entry.second;
+
+        std::cout << entry.first << " break " << (breakpoint.address == ANY_ADDRESS ? "*" : hex(breakpoint.address, 3));
+        if(breakpoint.comparison != Comparison::Always)
+            std::cout << " if " << (breakpoint.operand == REGISTER_I ? std::string("I") : "V" + std::string(1, "0123456789ABCDEF"[breakpoint.operand]))
+                      << " " << Debugger::comparisonName(breakpoint.comparison) << " " << hex(breakpoint.value, 2);
+        std::cout << "\n";
+    }
+
+    for(const auto& entry : session.debugger.watchpoints())
+        std::cout << entry.first << " watch " << hex(entry.second.address, 3) << " " << entry.second.length << " "
+                  << (entry.second.read ? "r" : "") << (entry.second.write ? "w" : "") << "\n";
+
+    std::cout << std::flush;
+}
+
+// False once the session should end
+static bool execute(Session& session, const std::string& line)
+{
+    std::istringstream arguments(line);
+    std::string command, first, second;
+    const MachineState& state = session.emulator.machineState();
+
+    if(!(arguments >> command) || command[0] == '#')
+        return true;
+
+    if(command == "quit" || command == "q")
+        return false;
+    else if(command == "break" || command == "b")
+        addBreakpoint(session, arguments);
+    else if(command == "watch" || command == "w")
+        addWatchpoint(session, arguments);
+    else if(command == "delete" || command == "d")
+    {
+        if(!(arguments >> first))
+            session.debugger.clear();
+        else if(!session.debugger.remove(parseNumber(first)))
+            throw std::runtime_error("No breakpoint or watchpoint " + first);
+    }
+    else if(command == "list" || command == "l")
+        listStops(session);
+    else if(command == "step" || command == "s")
+    {
+        unsigned int count = arguments >> first ? parseNumber(first) : 1;
+
+        for(unsigned int i = 0; i < count; i++)
+            if(session.step())
+            {
+                printStop(session, StopReason::Breakpoint, 0);
+                return true;
+            }
+        printInstruction(session, state.PC);
+    }
+    else if(command == "continue" || command == "c")
+    {
+        unsigned long long start = session.frameCount();
+        StopReason reason = session.run(arguments >> first ? parseNumber(first) : DEFAULT_CONTINUE_FRAMES);
+
+        printStop(session, reason, session.frameCount() - start);
+    }
+    else if(command == "regs" || command == "r")
+        printRegisters(session);
+    else if(command == "disasm" || command == "x")
+    {
+        SpecialRegister address = arguments >> first ? parseNumber(first) : std::max((int)state.PC - DISASSEMBLY_LINES / 2 * 2, 0);
+        unsigned int count = arguments >> second ? parseNumber(second) : DISASSEMBLY_LINES;
+
+        for(unsigned int i = 0; i < count; i++)
+            printInstruction(session, (address + i * 2) % MEMORY_SIZE);
+    }
+    else if(command == "mem" || command == "m")
+    {
+        if(!(arguments >> first))
+            throw std::runtime_error("Expected: mem ADDRESS [LENGTH]");
+        printMemory(session, parseNumber(first) % MEMORY_SIZE, arguments >> second ? parseNumber(second) : 16);
+    }
+    else if(command == "display")
+        printDisplay(session);
+    else if(command == "key" || command == "k")
+    {
+        if(!(arguments >> first >> second))
+            throw std::runtime_error("Expected: key KEY 1|0");
+        session.io.setKey(parseNumber(first), parseNumber(second));
+    }
+    else if(command == "help" || command == "h")
+        std::cout << help << std::flush;
+    else
+        throw std::runtime_error("Unknown command " + command + ", try help");
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    ExecutionMode mode = ExecutionMode::Interpreter;
+    QuirkProfile quirks = QuirkProfile::Default;
+    unsigned int instructionsPerSecond = DEFAULT_INSTRUCTIONS_PER_SECOND;
+    unsigned long long seed = 0;
+    const char* scriptFile = nullptr;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--jit")
+            mode = ExecutionMode::Recompiler;
+        else if(option == "--ips" && argument + 1 < argc && std::strtoul(argv[argument + 1], nullptr, 10) > 0)
+            instructionsPerSecond = std::strtoul(argv[++argument], nullptr, 10);
+        else if(option == "--seed" && argument + 1 < argc)
+            seed = std::strtoull(argv[++argument], nullptr, 0);
+        else if(option == "--quirks" && argument + 1 < argc && parseQuirkProfile(argv[argument + 1], quirks))
+            argument++;
+        else if(option == "--script" && argument + 1 < argc)
+            scriptFile = argv[++argument];
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument >= argc)
+    {
+        std::cerr << "Usage: chip8debug [--jit] [--ips N] [--seed N] [--quirks NAME] [--script commands.txt] program.ch8" << std::endl;
+        return 1;
+    }
+
+    if(!std::ifstream(argv[argument]))
+    {
+        std::cerr << "Could not open " << argv[argument] << std::endl;
+        return 1;
+    }
+
+    std::ifstream script;
+    if(scriptFile)
+    {
+        script.open(scriptFile);
+        if(!script)
+        {
+            std::cerr << "Could not open " << scriptFile << std::endl;
+            return 1;
+        }
+    }
+
+    // Same setup as a batch run, so the seed gives the same machine
+    Session session(instructionsPerSecond);
+    session.emulator.setExecutionMode(mode);
+    session.emulator.setQuirkProfile(quirks);
+    session.emulator.reset();
+    session.emulator.seed(seed);
+    session.emulator.load(argv[argument]);
+
+    std::istream& in = scriptFile ? script : std::cin;
+    bool interactive = !scriptFile && isatty(STDIN_FILENO);
+    std::string line;
+
+    printInstruction(session, session.emulator.machineState().PC);
+
+    while(true)
+    {
+        if(interactive)
+            std::cout << "(chip8) " << std::flush;
+        if(!std::getline(in, line))
+            break;
+
+        // Scripted sessions echo their commands so the output reads on its own
+        if(!interactive && !line.empty() && line[0] != '#')
+            std::cout << "> " << line << std::endl;
+
+        try
+        {
+            if(!execute(session, line))
+                break;
+        }
+        catch(const std::exception& error)
+        {
+            std::cout << error.what() << std::endl;
+
+            // A script that went wrong would stop in the wrong places
+            if(!interactive)
+                return 1;
+        }
+    }
+
+    return 0;
+}
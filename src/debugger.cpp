@@ -0,0 +1,299 @@
+#include "debugger.h"
+#include <cstdio>
+
+#define ADDRESS(instruction) (instruction & 0xfff)
+#define REGISTER_X(instruction) ((instruction >> 8) & 0xf)
+#define REGISTER_Y(instruction) ((instruction >> 4) & 0xf)
+#define SECOND_ARG(instruction) (instruction & 0xff)
+#define THIRD_ARG(instruction) (instruction & 0xf)
+
+static const char* comparisonNames[] = {
+    "", "==", "!=", "<", "<=", ">", ">="
+};
+
+/////////////////////////////////////////////////////////////////////////
+
+Debugger::Debugger(CHIP8Emulator& emulator)
+    : emulator(emulator), nextId(1), anywhere(0), stop(), watchHit(false), resumeCycle(~0ULL)
+{
+
+}
+
+Debugger::~Debugger()
+{
+    emulator.setDebugger(nullptr);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+unsigned int Debugger::addBreakpoint(const Breakpoint& breakpoint)
+{
+    breaks[nextId] = breakpoint;
+    update();
+
+    return nextId++;
+}
+
+unsigned int Debugger::addWatchpoint(const Watchpoint& watchpoint)
+{
+    watches[nextId] = watchpoint;
+    update();
+
+    return nextId++;
+}
+
+bool Debugger::remove(unsigned int id)
+{
+    if(!breaks.erase(id) && !watches.erase(id))
+        return false;
+
+    update();
+
+    return true;
+}
+
+void Debugger::clear()
+{
+    breaks.clear();
+    watches.clear();
+    update();
+}
+
+const std::map<unsigned int, Breakpoint>& Debugger::breakpoints() const
+{
+    return breaks;
+}
+
+const std::map<unsigned int, Watchpoint>& Debugger::watchpoints() const
+{
+    return watches;
+}
+
+const DebugStop& Debugger::lastStop() const
+{
+    return stop;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool Debugger::breakBefore(const MachineState& state)
+{
+    if(!anywhere && !breakAt[state.PC])
+        return false;
+
+    // Stopped right here last time, this run is the one that goes on
+    if(state.cycles == resumeCycle)
+        return false;
+
+    for(const auto& entry : breaks)
+    {
+        const Breakpoint& breakpoint = entry.second;
+
+        if((breakpoint.address == ANY_ADDRESS || breakpoint.address == state.PC) && holds(breakpoint, state))
+        {
+            stop = { entry.first, state.PC, 0, 0, false };
+            resumeCycle = state.cycles;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Debugger::access(SpecialRegister address, unsigned int length, bool write, SpecialRegister pc)
+{
+    const std::bitset<MEMORY_SIZE>& watched = write ? writeWatched : readWatched;
+    unsigned int i = 0;
+
+    while(i < length && !watched[(address + i) % MEMORY_SIZE])
+        i++;
+    if(i == length || watchHit)
+        return;
+
+    // The first matching watchpoint, in the order they were set
+    for(const auto& entry : watches)
+    {
+        const Watchpoint& watchpoint = entry.second;
+
+        if(!(write ? watchpoint.write : watchpoint.read))
+            continue;
+
+        for(unsigned int j = i; j < length; j++)
+            if((address + j - watchpoint.address) % MEMORY_SIZE < watchpoint.length)
+            {
+                stop = { entry.first, pc, address, (unsigned short)length, write };
+                watchHit = true;
+                return;
+            }
+    }
+}
+
+bool Debugger::hit()
+{
+    bool wasHit = watchHit;
+    watchHit = false;
+
+    return wasHit;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+std::string Debugger::disassemble(unsigned short instruction)
+{
+    unsigned int x = REGISTER_X(instruction);
+    unsigned int y = REGISTER_Y(instruction);
+    char text[32];
+
+    // Anything the switch does not recognise stays data
+    std::snprintf(text, sizeof(text), "DW 0x%04x", instruction);
+
+    switch(instruction >> 12)
+    {
+    case 0x0:
+        if(instruction == 0x00e0)
+            return "CLS";
+        if(instruction == 0x00ee)
+            return "RET";
+        std::snprintf(text, sizeof(text), "SYS 0x%03x", ADDRESS(instruction));
+        break;
+    case 0x1:
+        std::snprintf(text, sizeof(text), "JP 0x%03x", ADDRESS(instruction));
+        break;
+    case 0x2:
+        std::snprintf(text, sizeof(text), "CALL 0x%03x", ADDRESS(instruction));
+        break;
+    case 0x3:
+        std::snprintf(text, sizeof(text), "SE V%X, 0x%02x", x, SECOND_ARG(instruction));
+        break;
+    case 0x4:
+        std::snprintf(text, sizeof(text), "SNE V%X, 0x%02x", x, SECOND_ARG(instruction));
+        break;
+    case 0x5:
+        if(THIRD_ARG(instruction))
+            break;
+        std::snprintf(text, sizeof(text), "SE V%X, V%X", x, y);
+        break;
+    case 0x6:
+        std::snprintf(text, sizeof(text), "LD V%X, 0x%02x", x, SECOND_ARG(instruction));
+        break;
+    case 0x7:
+        std::snprintf(text, sizeof(text), "ADD V%X, 0x%02x", x, SECOND_ARG(instruction));
+        break;
+    case 0x8:
+    {
+        static const char* operations[16] = {
+            "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+        };
+
+        if(operations[THIRD_ARG(instruction)])
+            std::snprintf(text, sizeof(text), "%s V%X, V%X", operations[THIRD_ARG(instruction)], x, y);
+        break;
+    }
+    case 0x9:
+        if(THIRD_ARG(instruction))
+            break;
+        std::snprintf(text, sizeof(text), "SNE V%X, V%X", x, y);
+        break;
+    case 0xa:
+        std::snprintf(text, sizeof(text), "LD I, 0x%03x", ADDRESS(instruction));
+        break;
+    case 0xb:
+        std::snprintf(text, sizeof(text), "JP V0, 0x%03x", ADDRESS(instruction));
+        break;
+    case 0xc:
+        std::snprintf(text, sizeof(text), "RND V%X, 0x%02x", x, SECOND_ARG(instruction));
+        break;
+    case 0xd:
+        std::snprintf(text, sizeof(text), "DRW V%X, V%X, %d", x, y, THIRD_ARG(instruction));
+        break;
+    case 0xe:
+        if(SECOND_ARG(instruction) == 0x9e)
+            std::snprintf(text, sizeof(text), "SKP V%X", x);
+        else if(SECOND_ARG(instruction) == 0xa1)
+            std::snprintf(text, sizeof(text), "SKNP V%X", x);
+        break;
+    case 0xf:
+        switch(SECOND_ARG(instruction))
+        {
+        case 0x07: std::snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+        case 0x0a: std::snprintf(text, sizeof(text), "LD V%X, K", x); break;
+        case 0x15: std::snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+        case 0x18: std::snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+        case 0x1e: std::snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+        case 0x29: std::snprintf(text, sizeof(text), "LD F, V%X", x); break;
+        case 0x33: std::snprintf(text, sizeof(text), "LD B, V%X", x); break;
+        case 0x55: std::snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+        case 0x65: std::snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+        }
+        break;
+    }
+
+    return text;
+}
+
+bool Debugger::parseComparison(const std::string& text, Comparison& comparison)
+{
+    for(int i = (int)Comparison::Equal; i <= (int)Comparison::GreaterEqual; i++)
+        if(text == comparisonNames[i])
+        {
+            comparison = (Comparison)i;
+            return true;
+        }
+
+    return false;
+}
+
+const char* Debugger::comparisonName(Comparison comparison)
+{
+    return comparisonNames[(int)comparison];
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool Debugger::holds(const Breakpoint& breakpoint, const MachineState& state) const
+{
+    unsigned short value = breakpoint.operand == REGISTER_I ? state.I : state.V[breakpoint.operand % NUM_GENERAL_REGISTERS];
+
+    switch(breakpoint.comparison)
+    {
+    case Comparison::Always:       return true;
+    case Comparison::Equal:        return value == breakpoint.value;
+    case Comparison::NotEqual:     return value != breakpoint.value;
+    case Comparison::Less:         return value < breakpoint.value;
+    case Comparison::LessEqual:    return value <= breakpoint.value;
+    case Comparison::Greater:      return value > breakpoint.value;
+    case Comparison::GreaterEqual: return value >= breakpoint.value;
+    }
+
+    return false;
+}
+
+// Attached only while there is something to stop at, so an idle debugger
+// leaves the emulator on its block loop
+void Debugger::update()
+{
+    breakAt.reset();
+    readWatched.reset();
+    writeWatched.reset();
+    anywhere = 0;
+
+    for(const auto& entry : breaks)
+    {
+        if(entry.second.address == ANY_ADDRESS)
+            anywhere++;
+        else
+            breakAt[entry.second.address % MEMORY_SIZE] = true;
+    }
+
+    for(const auto& entry : watches)
+        for(unsigned int i = 0; i < entry.second.length; i++)
+        {
+            unsigned int address = (entry.second.address + i) % MEMORY_SIZE;
+
+            readWatched[address]  = readWatched[address] || entry.second.read;
+            writeWatched[address] = writeWatched[address] || entry.second.write;
+        }
+
+    emulator.setDebugger(breaks.empty() && watches.empty() ? nullptr : this);
+}
@@ -0,0 +1,104 @@
+#ifndef _DEBUGGER_H
+#define _DEBUGGER_H
+
+#include "emulator.h"
+#include <bitset>
+#include <map>
+#include <string>
+
+#define REGISTER_I NUM_GENERAL_REGISTERS    // Operand of a condition on I
+#define ANY_ADDRESS -1
+
+enum class Comparison
+{
+    Always,         // No condition
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual
+};
+
+/* Stops before the instruction at address runs, if the condition holds */
+struct Breakpoint
+{
+    int address;                    // ANY_ADDRESS to check before every instruction
+    unsigned char operand;          // VX, or REGISTER_I
+    Comparison comparison;
+    unsigned short value;
+};
+
+/* Stops after an instruction read or wrote any byte of the range through I */
+struct Watchpoint
+{
+    SpecialRegister address;
+    unsigned short length;
+    bool read;
+    bool write;
+};
+
+struct DebugStop
+{
+    unsigned int id;                // Of the breakpoint or watchpoint, 0 before any stop
+    SpecialRegister pc;             // Instruction that stopped, or that accessed memory
+    SpecialRegister address;        // Accessed range, watchpoints only
+    unsigned short length;
+    bool write;
+};
+
+/*
+ * Breakpoints and watchpoints for one emulator. The debugger attaches
+ * itself only while it has any, and run*() then steps one instruction at a
+ * time, asking breakBefore() before each and hit() after it. Without any
+ * the emulator runs its usual blocks and pays one null check per call.
+ */
+class Debugger
+{
+public:
+    /* Constructors and destructor */
+    explicit Debugger(CHIP8Emulator& emulator);
+    ~Debugger();
+
+    /* Instance methods */
+    unsigned int addBreakpoint(const Breakpoint& breakpoint);
+    unsigned int addWatchpoint(const Watchpoint& watchpoint);
+    bool remove(unsigned int id);
+    void clear();
+    const std::map<unsigned int, Breakpoint>& breakpoints() const;
+    const std::map<unsigned int, Watchpoint>& watchpoints() const;
+    const DebugStop& lastStop() const;
+
+    /* Called by the emulator while attached */
+    bool breakBefore(const MachineState& state);
+    void access(SpecialRegister address, unsigned int length, bool write, SpecialRegister pc);
+    bool hit();
+
+    /* Static methods */
+    static std::string disassemble(unsigned short instruction);
+    static bool parseComparison(const std::string& text, Comparison& comparison);
+    static const char* comparisonName(Comparison comparison);
+private:
+    /* Auxiliary methods */
+    bool holds(const Breakpoint& breakpoint, const MachineState& state) const;
+    void update();
+private:
+    CHIP8Emulator& emulator;
+    std::map<unsigned int, Breakpoint> breaks;
+    std::map<unsigned int, Watchpoint> watches;
+    unsigned int nextId;
+
+    /* Quick rejects, most instructions and accesses match nothing */
+    std::bitset<MEMORY_SIZE> breakAt;
+    std::bitset<MEMORY_SIZE> readWatched;
+    std::bitset<MEMORY_SIZE> writeWatched;
+    unsigned int anywhere;
+
+    DebugStop stop;
+    bool watchHit;
+
+    /* A stop before an instruction must let it run when resumed */
+    unsigned long long resumeCycle;
+};
+
+#endif  // _DEBUGGER_H
@@ -1,341 +1,1440 @@
 #include "emulator.h"
-#include "ncursesio.h"
+#include "coverage.h"
+#include "debugger.h"
+#include "precompiled.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "registerinstructions.h"
+#include "x86recompiler.h"
+#include <algorithm>
+#include <cstddef>
 #include <cstring>
 #include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 
-#define NUM_GENERAL_REGISTERS 16
-#define MEMORY_SIZE 4096
-#define NUM_LINES 32
-#define NUM_COLUMNS 64
-#define NUM_PIXELS (NUM_COLUMNS * NUM_LINES)
-#define STACK_LEVEL 16
-#define NUM_KEYS 16
+#define NUM_LINES DISPLAY_LINES
+#define NUM_COLUMNS DISPLAY_COLUMNS
 #define PROGRAM_LOCATION 0x200
+#define NUM_INSTRUCTION_SLOTS (MEMORY_SIZE / 2)
+#define MAX_BLOCK_LENGTH 64
+#define MIN_IDLE_SKIP 4         // Shorter remainders are cheaper to run than to check
+#define MIN_UNPARKED_SKIP 64    // The same for loops that must be checked again every slice
+#define DIRTY_PAGE_SIZE 64
 #define ADDRESS(instruction) (instruction & 0xfff)
 #define REGISTER_X(instruction) ((instruction >> 8) & 0xf)
 #define REGISTER_Y(instruction) ((instruction >> 4) & 0xf)
 #define SECOND_ARG(instruction) (instruction & 0xff)
 #define THIRD_ARG(instruction) (instruction & 0xf)
 
+static_assert(MEMORY_SIZE / DIRTY_PAGE_SIZE == 64, "Dirty pages must fit one bit each in a 64-bit mask");
+
+// Bump whenever the layout of MachineState changes
+#define STATE_MAGIC "C8ST"
+#define STATE_VERSION 3
+
 /////////////////////////////////////////////////////////////////////////
 
-void CHIP8Emulator::run(const std::string& file)
+CHIP8Emulator::CHIP8Emulator(IO& io)
+    : state(), quirks(QuirkProfile::Default), decoder(decoderFor(QuirkProfile::Default)), code(nullptr), idleSkipping(true), idle(), skippedCycles(0), mode(ExecutionMode::Interpreter), recompiler(nullptr), precompiled(nullptr), io(&io), profiler(nullptr), recorder(nullptr), coverage(nullptr), debugger(nullptr), dirtyPages(0), guestFaults(0), firstFault(0)
+{
+    state.PC = PROGRAM_LOCATION;
+
+    // The first frame repaints everything
+    std::memset(dirty, 0xff, sizeof(dirty));
+
+    std::random_device seed;
+    state.randomState = ((unsigned long long)seed() << 32) | seed();
+}
+
+CHIP8Emulator::CHIP8Emulator(const CHIP8Emulator& other)
+    : state(other.state), quirks(other.quirks), decoder(other.decoder), code(nullptr), idleSkipping(other.idleSkipping), idle(), skippedCycles(other.skippedCycles), mode(ExecutionMode::Interpreter), recompiler(nullptr), precompiled(other.precompiled ? new PrecompiledCode(*other.precompiled) : nullptr), io(other.io), profiler(other.profiler), recorder(other.recorder), coverage(other.coverage), debugger(nullptr), dirtyPages(other.dirtyPages), guestFaults(other.guestFaults), firstFault(other.firstFault)
+{
+    std::memcpy(dirty, other.dirty, sizeof(dirty));
+
+    setExecutionMode(other.mode);
+}
+
+CHIP8Emulator::CHIP8Emulator(CHIP8Emulator&& other)
+    : state(other.state), quirks(other.quirks), decoder(other.decoder), code(other.code), idleSkipping(other.idleSkipping), idle(), skippedCycles(other.skippedCycles), mode(other.mode), recompiler(other.recompiler), precompiled(other.precompiled), io(other.io), profiler(other.profiler), recorder(other.recorder), coverage(other.coverage), debugger(nullptr), dirtyPages(other.dirtyPages), guestFaults(other.guestFaults), firstFault(other.firstFault)
+{
+    std::memcpy(dirty, other.dirty, sizeof(dirty));
+
+    other.code        = nullptr;
+    other.recompiler  = nullptr;
+    other.precompiled = nullptr;
+}
+
+CHIP8Emulator& CHIP8Emulator::operator=(const CHIP8Emulator& other)
+{
+    state    = other.state;
+    io       = other.io;
+    profiler = other.profiler;
+    recorder = other.recorder;
+    coverage = other.coverage;
+    dirtyPages  = other.dirtyPages;
+    guestFaults = other.guestFaults;
+    firstFault  = other.firstFault;
+    idleSkipping = other.idleSkipping;
+    skippedCycles = other.skippedCycles;
+    std::memcpy(dirty, other.dirty, sizeof(dirty));
+
+    // Native code was generated for the old profile's quirks, like in setQuirkProfile()
+    if(quirks != other.quirks)
+    {
+        delete recompiler;
+        recompiler = nullptr;
+    }
+    quirks = other.quirks;
+    decoder = other.decoder;
+
+    // Caches and translations refer to the old contents of mem, start over
+    delete code;
+    code = nullptr;
+
+    setExecutionMode(other.mode);
+    if(recompiler)
+        recompiler->reset();
+
+    // Precompiled blocks follow what was written to mem, keep the other's view
+    delete precompiled;
+    precompiled = other.precompiled ? new PrecompiledCode(*other.precompiled) : nullptr;
+
+    return *this;
+}
+
+CHIP8Emulator& CHIP8Emulator::operator=(CHIP8Emulator&& other)
+{
+    state    = other.state;
+    io       = other.io;
+    profiler = other.profiler;
+    recorder = other.recorder;
+    coverage = other.coverage;
+    dirtyPages  = other.dirtyPages;
+    guestFaults = other.guestFaults;
+    firstFault  = other.firstFault;
+    idleSkipping = other.idleSkipping;
+    skippedCycles = other.skippedCycles;
+    quirks = other.quirks;
+    decoder = other.decoder;
+    mode  = other.mode;
+    std::memcpy(dirty, other.dirty, sizeof(dirty));
+
+    delete code;
+    delete recompiler;
+    delete precompiled;
+    code        = other.code;
+    recompiler  = other.recompiler;
+    precompiled = other.precompiled;
+
+    other.code        = nullptr;
+    other.recompiler  = nullptr;
+    other.precompiled = nullptr;
+
+    return *this;
+}
+
+CHIP8Emulator::~CHIP8Emulator()
+{
+    delete code;
+    delete recompiler;
+    delete precompiled;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void CHIP8Emulator::load(const std::string& file)
+{
+    std::ifstream program(file);
+
+    program.read((char *)&state.mem[PROGRAM_LOCATION], 0xe00);
+    invalidateCode(PROGRAM_LOCATION, 0xe00);
+
+    // Loading a program is not self-modification, forget it was written
+    if(recompiler)
+        recompiler->reset();
+    armPrecompiled();
+    dirtyPages = 0;
+}
+
+void CHIP8Emulator::runTick()
+{
+    DecodedInstruction instruction = decodedAt(state.PC);
+
+    if(profiler)
+        profiler->countInstruction(state.PC, instruction.family);
+    if(coverage)
+        coverage->visit(state.PC, nextInstruction());
+
+    advancePC();
+    instruction.handler(*this, instruction);
+    state.cycles++;
+}
+
+unsigned int CHIP8Emulator::runBlock()
+{
+    unsigned char length = blockAt(state.PC);
+
+    if(recorder && recorder->tracing())
+        return traceBlock(length ? length : 1);
+
+    // Odd addresses are never cached, step them one at a time
+    if(!length)
+    {
+        runTick();
+        return 1;
+    }
+
+    runBlock(length);
+
+    return length;
+}
+
+unsigned long CHIP8Emulator::runCycles(unsigned long count)
+{
+    unsigned long long start = state.cycles;
+
+    runBlocks(state.cycles + count, [] { return false; }, StopReason::BudgetExhausted);
+
+    return state.cycles - start;
+}
+
+StopReason CHIP8Emulator::runFor(unsigned long cycles)
+{
+    return runBlocks(state.cycles + cycles, [] { return false; }, StopReason::BudgetExhausted);
+}
+
+StopReason CHIP8Emulator::runUntilFrame(unsigned long cycles)
+{
+    return runBlocks(state.cycles + cycles, [this] { return state.frameReady; }, StopReason::FrameReady);
+}
+
+void CHIP8Emulator::updateTimers()
+{
+    // The tone covers the frame that just ran, FX18 with 1 plays one frame
+    io->beep(state.soundTimer > 0);
+
+    updateDelayTimer();
+    updateSoundTimer();
+}
+
+unsigned long long CHIP8Emulator::cycleCount() const
+{
+    return state.cycles;
+}
+
+// Subtracted from cycleCount(), what actually ran
+unsigned long long CHIP8Emulator::skippedCycleCount() const
+{
+    return skippedCycles;
+}
+
+unsigned short CHIP8Emulator::nextInstruction() const
+{
+    return ((unsigned short)state.mem[state.PC]) << 8 | state.mem[(state.PC+1) % MEMORY_SIZE];
+}
+
+unsigned long long CHIP8Emulator::frameHash() const
+{
+    return hashFrame(state.gfx);
+}
+
+// The loop behind every run*() method, stop is checked between blocks
+// and is inlined into each caller's copy
+template<class Stop>
+StopReason CHIP8Emulator::runBlocks(unsigned long long end, Stop stop, StopReason reason)
+{
+    // Decided once per run, the block loop below never looks for breakpoints
+    if(debugger)
+        return debugBlocks(end, stop, reason);
+
+    // A loop parked in an earlier slice may take the whole budget
+    if(idle.blocks && !stop())
+        resumeIdleLoop(end);
+
+    // Whole blocks only, the last one may overrun the budget
+    while(state.cycles < end)
+    {
+        if(stop())
+            return reason;
+
+        SpecialRegister block = state.PC;
+
+        runBlock();
+
+        // Nothing can happen before the next key poll, let the budget pass
+        if(state.waitingForKey)
+        {
+            skipTo(end);
+            return StopReason::WaitingForKey;
+        }
+
+        // Only a backward jump can close a busy-wait loop
+        if(state.PC <= block && idleSkipping && state.cycles + MIN_IDLE_SKIP < end)
+            skipIdleLoop(block, end);
+    }
+
+    return stop() ? reason : StopReason::BudgetExhausted;
+}
+
+// runBlocks one instruction at a time, so the debugger sees each one before
+// it runs and every memory access it made. Blocks still end where they
+// would, a debugged run that never stops keeps the cycle counts of one
+// that is not debugged
+template<class Stop>
+StopReason CHIP8Emulator::debugBlocks(unsigned long long end, Stop stop, StopReason reason)
+{
+    while(state.cycles < end)
+    {
+        if(stop())
+            return reason;
+
+        SpecialRegister block = state.PC;
+        unsigned char length = std::max(blockAt(state.PC), (unsigned char)1);
+
+        for(unsigned char i = 0; i < length; i++)
+        {
+            if(debugger->breakBefore(state))
+                return StopReason::Breakpoint;
+
+            runTick();
+
+            if(debugger->hit())
+                return StopReason::Breakpoint;
+        }
+
+        if(state.waitingForKey)
+        {
+            skipTo(end);
+            return StopReason::WaitingForKey;
+        }
+
+        if(state.PC <= block && idleSkipping && state.cycles + MIN_IDLE_SKIP < end)
+            skipIdleLoop(block, end);
+    }
+
+    return stop() ? reason : StopReason::BudgetExhausted;
+}
+
+// Blocks are only trusted while mem holds the exact program and quirk
+// profile chip8aot compiled, anything else runs the usual way
+void CHIP8Emulator::armPrecompiled()
+{
+    const PrecompiledProgram* program = findPrecompiled(state.mem, quirks);
+
+    if(!program)
+    {
+        delete precompiled;
+        precompiled = nullptr;
+    }
+    else if(precompiled)
+        *precompiled = PrecompiledCode(*program);
+    else
+        precompiled = new PrecompiledCode(*program);
+}
+
+void CHIP8Emulator::runBlock(unsigned char length)
+{
+    DecodedInstruction terminator = codeCache().decoded[state.PC / 2 + length - 1];
+    CompiledBlock compiled = precompiled ? precompiled->lookup(state.PC, length) : nullptr;
+
+    if(!compiled && recompiler)
+        compiled = recompiler->lookup(state.PC, length, state.mem);
+
+    if(profiler)
+        profiler->countBlock(state.PC, &codeCache().decoded[state.PC / 2], length);
+    if(coverage)
+        coverage->visit(state.PC, state.mem[state.PC + (length - 1) * 2] << 8 | state.mem[state.PC + (length - 1) * 2 + 1]);
+
+    // Only the last instruction may branch or write memory, so the body
+    // can run back to back
+    if(compiled && mode == ExecutionMode::Differential)
+        runDifferential(compiled, length);
+    else if(compiled)
+    {
+        compiled(state.V, &state.I);
+        setPC(state.PC + (length - 1) * 2);
+    }
+    else
+        runBody(length);
+
+    advancePC();
+    terminator.handler(*this, terminator);
+    state.cycles += length;
+}
+
+// Step one instruction at a time so every step can be logged, a block is
+// still run whole to keep cycle counts identical to untraced runs
+unsigned int CHIP8Emulator::traceBlock(unsigned char length)
+{
+    GeneralRegister V[NUM_GENERAL_REGISTERS];
+
+    for(unsigned char i = 0; i < length; i++)
+    {
+        SpecialRegister pc = state.PC;
+        SpecialRegister I = state.I;
+        unsigned short opcode = nextInstruction();
+
+        std::memcpy(V, state.V, sizeof(V));
+        runTick();
+        recorder->recordStep(pc, opcode, V, I, state);
+    }
+
+    return length;
+}
+
+// Loops made only of instructions that read memory, keys and timers and
+// write registers and timers repeat the same way until the next slice
+// once one iteration leaves the registers as it found them
+bool CHIP8Emulator::isIdleLoop(SpecialRegister head, SpecialRegister jump)
+{
+    unsigned char& verdict = codeCache().idleLoop[jump / 2];
+
+    if(verdict)
+        return verdict != 2;
+
+    verdict = 1;
+    for(SpecialRegister address = head; address <= jump; address += 2)
+        switch(decodedAt(address).family)
+        {
+        case FAMILY_0NNN:
+        case FAMILY_1NNN:
+        case FAMILY_3XNN:
+        case FAMILY_4XNN:
+        case FAMILY_5XY0:
+        case FAMILY_6XNN:
+        case FAMILY_8XY0:
+        case FAMILY_9XY0:
+        case FAMILY_ANNN:
+        case FAMILY_EX9E:
+        case FAMILY_EXA1:
+        case FAMILY_FX07:
+        case FAMILY_FX15:
+        case FAMILY_FX18:
+        case FAMILY_FX29:
+        case FAMILY_UNKNOWN:
+            break;
+        default:
+            verdict = 2;
+            return false;
+        }
+
+    return true;
+}
+
+void CHIP8Emulator::skipIdleLoop(SpecialRegister block, unsigned long long end)
+{
+    // Counts, traces, breakpoints and watchpoints must see every step
+    if(profiler || debugger || (recorder && recorder->tracing()) || (block & 1))
+        return;
+
+    unsigned char length = codeCache().blockLength[block / 2];
+    SpecialRegister jump = block + (length - 1) * 2;
+    SpecialRegister head = state.PC;
+
+    if(!length || code->decoded[jump / 2].family != FAMILY_1NNN || (head & 1))
+        return;
+    if(jump - head >= MAX_IDLE_LOOP * 2 || !isIdleLoop(head, jump))
+        return;
+    if(code->idleLoop[jump / 2] == 3 && state.cycles + MIN_UNPARKED_SKIP >= end)
+        return;
+
+    GeneralRegister V[NUM_GENERAL_REGISTERS];
+    SpecialRegister I = state.I;
+    Timer delayTimer = state.delayTimer;
+    Timer soundTimer = state.soundTimer;
+    unsigned long long start = state.cycles;
+    IdleLoop iteration;
+
+    std::memcpy(V, state.V, sizeof(V));
+    iteration.blocks = 0;
+
+    // One more iteration, exactly as runCycles would run it, noting where
+    // each block started
+    do
+    {
+        if(iteration.blocks < MAX_IDLE_LOOP)
+        {
+            unsigned char block = iteration.blocks++;
+            unsigned long long before = state.cycles;
+
+            iteration.pc[block] = state.PC;
+            iteration.I[block]  = state.I;
+            std::memcpy(iteration.V[block], state.V, sizeof(state.V));
+
+            runBlock();
+            iteration.length[block] = state.cycles - before;
+        }
+        else
+        {
+            iteration.blocks = MAX_IDLE_LOOP + 1;
+            runBlock();
+        }
+    }
+    while(state.PC != head && state.PC >= head && state.PC <= jump && state.cycles < end);
+
+    if(state.PC != head || state.cycles >= end)
+        return;
+    if(std::memcmp(V, state.V, sizeof(V)) || I != state.I || delayTimer != state.delayTimer || soundTimer != state.soundTimer)
+        return;
+
+    // Once a loop is known not to park it only pays off with a long remainder
+    iteration.period = state.cycles - start;
+    if(code->idleLoop[jump / 2] == 1 && (iteration.blocks > MAX_IDLE_LOOP || !parkIdleLoop(head, jump, iteration)))
+        code->idleLoop[jump / 2] = 3;
+
+    // Every further iteration is the same, skip all that fit before the end
+    unsigned long long period = state.cycles - start;
+    skipTo(state.cycles + (end - state.cycles - 1) / period * period);
+}
+
+// Keeps an iteration that returned to its head unchanged for the next
+// slices, false if it cannot be replayed there. A loop that writes a timer
+// would undo the decrement between slices. A register FX07 loads must only
+// be compared with constants, the rest of the loop has to be the same
+// whatever the timer is
+bool CHIP8Emulator::parkIdleLoop(SpecialRegister head, SpecialRegister jump, const IdleLoop& iteration)
+{
+    unsigned short loads = 0;
+
+    for(SpecialRegister address = head; address <= jump; address += 2)
+        switch(code->decoded[address / 2].family)
+        {
+        case FAMILY_FX07:
+            loads |= 1 << code->decoded[address / 2].x;
+            break;
+        case FAMILY_FX15:
+        case FAMILY_FX18:
+            return false;
+        default:
+            break;
+        }
+
+    unsigned char constants[MAX_IDLE_LOOP];
+    unsigned char numConstants = 0;
+    bool readsKeys = false;
+
+    for(SpecialRegister address = head; address <= jump; address += 2)
+    {
+        const DecodedInstruction& instruction = code->decoded[address / 2];
+        unsigned short x = 1 << instruction.x, y = 1 << instruction.y;
+
+        switch(instruction.family)
+        {
+        case FAMILY_3XNN:
+        case FAMILY_4XNN:
+            if((loads & x) && !std::memchr(constants, instruction.n, numConstants))
+                constants[numConstants++] = instruction.n;
+            break;
+        case FAMILY_6XNN:
+        case FAMILY_FX29:
+            if(loads & x)
+                return false;
+            break;
+        case FAMILY_5XY0:
+        case FAMILY_8XY0:
+        case FAMILY_9XY0:
+            if(loads & (x | y))
+                return false;
+            break;
+        case FAMILY_EX9E:
+        case FAMILY_EXA1:
+            if(loads & x)
+                return false;
+            readsKeys = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    idle = iteration;
+    idle.jump = jump;
+    idle.timerRegisters = loads;
+    std::memcpy(idle.constants, constants, numConstants);
+    idle.numConstants = numConstants;
+    idle.delayTimer = state.delayTimer;
+    idle.readsKeys = readsKeys;
+    idle.keys = state.keys;
+
+    // Blocks are straight runs, a branch always ends one
+    for(unsigned char block = 0; block < idle.blocks; block++)
+    {
+        idle.timerLoads[block] = 0;
+        for(unsigned char i = 0; i < idle.length[block]; i++)
+        {
+            const DecodedInstruction& instruction = code->decoded[(idle.pc[block] / 2 + i) % NUM_INSTRUCTION_SLOTS];
+            if(instruction.family == FAMILY_FX07)
+                idle.timerLoads[block] |= 1 << instruction.x;
+        }
+    }
+
+    return true;
+}
+
+// Whether the loop's comparisons see value the way they saw the recorded timer
+bool CHIP8Emulator::sameTimerClass(Timer value) const
+{
+    for(unsigned char i = 0; i < idle.numConstants; i++)
+        if((value == idle.constants[i]) != (idle.delayTimer == idle.constants[i]))
+            return false;
+
+    return true;
+}
+
+// Runs a whole budget of a parked loop without running it: the loop still
+// sits at the start of one of its blocks with the registers it had there,
+// and nothing it reads changed in a way it can tell, so it repeats the
+// recorded iteration and stops at the first block boundary at or past the
+// end, like runBlocks. Registers FX07 loads hold the timer once it ran
+void CHIP8Emulator::resumeIdleLoop(unsigned long long end)
+{
+    if(profiler || (recorder && recorder->tracing()) || !idleSkipping || state.cycles >= end)
+        return;
+
+    // Code written since, another machine restored over this one, or input the loop would see
+    if(!code || code->idleLoop[idle.jump / 2] != 1 || (idle.readsKeys && state.keys != idle.keys) ||
+       !sameTimerClass(state.delayTimer))
+    {
+        idle.blocks = 0;
+        return;
+    }
+
+    unsigned char block;
+    for(block = 0; block < idle.blocks; block++)
+    {
+        if(idle.pc[block] != state.PC || idle.I[block] != state.I)
+            continue;
+
+        int i = 0;
+        while(i < NUM_GENERAL_REGISTERS && ((idle.timerRegisters & (1 << i)) ? sameTimerClass(state.V[i]) : idle.V[block][i] == state.V[i]))
+            i++;
+        if(i == NUM_GENERAL_REGISTERS)
+            break;
+    }
+
+    if(block == idle.blocks)
+    {
+        idle.blocks = 0;
+        return;
+    }
+
+    unsigned long long cycles = state.cycles;
+    unsigned long long iterations = (end - cycles - 1) / idle.period;
+    unsigned short loaded = 0;
+
+    if(iterations)
+    {
+        cycles += iterations * idle.period;
+        for(unsigned char i = 0; i < idle.blocks; i++)
+            loaded |= idle.timerLoads[i];
+    }
+
+    while(cycles < end)
+    {
+        cycles += idle.length[block];
+        loaded |= idle.timerLoads[block];
+        block = (block + 1) % idle.blocks;
+    }
+
+    state.PC = idle.pc[block];
+    state.I  = idle.I[block];
+    for(int i = 0; i < NUM_GENERAL_REGISTERS; i++)
+        if(loaded & (1 << i))
+            state.V[i] = state.delayTimer;
+        else if(!(idle.timerRegisters & (1 << i)))
+            state.V[i] = idle.V[block][i];
+    skipTo(cycles);
+}
+
+void CHIP8Emulator::skipTo(unsigned long long cycle)
+{
+    if(cycle > state.cycles)
+    {
+        skippedCycles += cycle - state.cycles;
+        state.cycles   = cycle;
+    }
+}
+
+bool CHIP8Emulator::hasNewFrame() const
+{
+    return state.frameReady;
+}
+
+void CHIP8Emulator::drawFrame()
+{
+    state.frameReady = false;
+
+    if(recorder)
+        recorder->recordFrame(state.cycles, frameHash());
+
+    if(profiler)
+    {
+        ScopedTimer timer(profiler->presentTime());
+        io->draw(state.gfx, dirty);
+    }
+    else
+        io->draw(state.gfx, dirty);
+    std::memset(dirty, 0, sizeof(dirty));
+}
+
+void CHIP8Emulator::updateKeys()
+{
+    io->updateKeys(state.cycles);
+    unsigned short keys = io->keyMask();
+
+    if(recorder && keys != state.keys)
+        recorder->recordKeys(state.cycles, keys);
+
+    state.keyPresses = keys & ~state.keys;
+    state.keys = keys;
+}
+
+void CHIP8Emulator::reset()
+{
+    // The random generator keeps running across resets
+    unsigned long long randomState = state.randomState;
+
+    std::memset(&state, 0, sizeof(state));
+    state.PC          = PROGRAM_LOCATION;
+    state.randomState = randomState;
+
+    std::memset(dirty, 0xff, sizeof(dirty));
+    dirtyPages  = 0;
+    guestFaults = 0;
+
+    if(code)
+        std::memset(code, 0, sizeof(CodeCache));
+
+    if(recompiler)
+        recompiler->reset();
+    armPrecompiled();
+}
+
+void CHIP8Emulator::setExecutionMode(ExecutionMode newMode)
+{
+    mode = newMode;
+
+    if(mode == ExecutionMode::Interpreter)
+    {
+        delete recompiler;
+        recompiler = nullptr;
+    }
+    else if(!recompiler)
+    {
+        recompiler = new X86Recompiler(quirkShiftUsesVY(quirks));
+
+        // Hosts without an executable arena keep interpreting
+        if(!recompiler->available())
+        {
+            delete recompiler;
+            recompiler = nullptr;
+        }
+    }
+}
+
+ExecutionMode CHIP8Emulator::executionMode() const
+{
+    return mode;
+}
+
+const MachineState& CHIP8Emulator::machineState() const
+{
+    return state;
+}
+
+void CHIP8Emulator::restoreState(const MachineState& snapshot)
+{
+    state = snapshot;
+
+    // Repaint the restored screen in full on the next frame
+    std::memset(dirty, 0xff, sizeof(dirty));
+    dirtyPages  = 0;
+    guestFaults = 0;
+
+    // Memory may hold a different program now
+    if(code)
+        std::memset(code, 0, sizeof(CodeCache));
+
+    if(recompiler)
+        recompiler->reset();
+    armPrecompiled();
+}
+
+// For going back to the same snapshot over and over: it must be the state
+// of the last reset, load or restore. Only the pages written since are
+// copied back, and only the code in them is decoded or translated again.
+void CHIP8Emulator::restoreDirtyPages(const MachineState& snapshot)
+{
+    for(unsigned long long pages = dirtyPages; pages; pages &= pages - 1)
+    {
+        unsigned int address = __builtin_ctzll(pages) * DIRTY_PAGE_SIZE;
+
+        std::memcpy(&state.mem[address], &snapshot.mem[address], DIRTY_PAGE_SIZE);
+        invalidateCode(address, DIRTY_PAGE_SIZE);
+    }
+
+    // Everything past mem is a few hundred bytes
+    std::memcpy((unsigned char *)&state + offsetof(MachineState, gfx), (const unsigned char *)&snapshot + offsetof(MachineState, gfx),
+                sizeof(MachineState) - offsetof(MachineState, gfx));
+
+    std::memset(dirty, 0xff, sizeof(dirty));
+    dirtyPages  = 0;
+    guestFaults = 0;
+}
+
+// Writes from outside the guest, cached code over them is dropped
+void CHIP8Emulator::writeMemory(SpecialRegister address, const unsigned char* data, unsigned short length)
+{
+    address %= MEMORY_SIZE;
+
+    for(unsigned short i = 0; i < length; i++)
+        state.mem[(address + i) % MEMORY_SIZE] = data[i];
+
+    // A write running off the end continues at 0
+    unsigned int first = std::min<unsigned int>(length, MEMORY_SIZE - address);
+    invalidateCode(address, first);
+    invalidateCode(0, std::min<unsigned int>(length - first, MEMORY_SIZE));
+}
+
+// "C8ST" <version:16> <quirk profile:16> <state size:32> <MachineState>,
+// all in host byte order, states are not meant to move between machines
+void CHIP8Emulator::saveState(std::ostream& out) const
+{
+    unsigned short version = STATE_VERSION;
+    unsigned short profile = (unsigned short)quirks;
+    unsigned int size = sizeof(state);
+
+    out.write(STATE_MAGIC, 4);
+    out.write((const char *)&version, sizeof(version));
+    out.write((const char *)&profile, sizeof(profile));
+    out.write((const char *)&size, sizeof(size));
+    out.write((const char *)&state, sizeof(state));
+
+    if(!out)
+        throw std::runtime_error("Could not write save state");
+}
+
+void CHIP8Emulator::loadState(std::istream& in)
+{
+    char magic[4];
+    unsigned short version = 0;
+    unsigned short profile = 0;
+    unsigned int size = 0;
+
+    in.read(magic, 4);
+    in.read((char *)&version, sizeof(version));
+    in.read((char *)&profile, sizeof(profile));
+    in.read((char *)&size, sizeof(size));
+    if(!in || std::memcmp(magic, STATE_MAGIC, 4) != 0)
+        throw std::runtime_error("Not a save state");
+    if(version != STATE_VERSION || size != sizeof(MachineState))
+        throw std::runtime_error("Save state was written by an incompatible version");
+    if(profile >= NUM_QUIRK_PROFILES)
+        throw std::runtime_error("Save state uses an unknown quirk profile");
+
+    // Read into a scratch copy so a truncated file leaves the machine untouched
+    MachineState snapshot;
+    in.read((char *)&snapshot, sizeof(snapshot));
+    if(!in)
+        throw std::runtime_error("Save state is truncated");
+
+    if(!isValidState(snapshot))
+        throw std::runtime_error("Save state is corrupt");
+
+    // The machine resumes under the interpreter it was saved from
+    if((QuirkProfile)profile != quirks)
+        setQuirkProfile((QuirkProfile)profile);
+    restoreState(snapshot);
+}
+
+void CHIP8Emulator::setProfiler(Profiler* newProfiler)
+{
+    profiler = newProfiler;
+}
+
+void CHIP8Emulator::setRecorder(Recorder* newRecorder)
+{
+    recorder = newRecorder;
+}
+
+void CHIP8Emulator::setCoverage(Coverage* newCoverage)
+{
+    coverage = newCoverage;
+}
+
+void CHIP8Emulator::setDebugger(Debugger* newDebugger)
+{
+    debugger = newDebugger;
+}
+
+unsigned char CHIP8Emulator::faults() const
+{
+    return guestFaults;
+}
+
+SpecialRegister CHIP8Emulator::faultAddress() const
+{
+    return firstFault;
+}
+
+void CHIP8Emulator::setIdleSkipping(bool enabled)
+{
+    idleSkipping = enabled;
+}
+
+void CHIP8Emulator::setQuirkProfile(QuirkProfile profile)
+{
+    quirks  = profile;
+    decoder = decoderFor(profile);
+
+    // Decoded handlers and native code belong to the old profile
+    if(code)
+        std::memset(code, 0, sizeof(CodeCache));
+
+    delete recompiler;
+    recompiler = nullptr;
+    setExecutionMode(mode);
+    armPrecompiled();
+}
+
+QuirkProfile CHIP8Emulator::quirkProfile() const
+{
+    return quirks;
+}
+
+void CHIP8Emulator::seed(unsigned long long value)
+{
+    // Same seeding as the PCG32 reference, so nearby seeds diverge at once
+    state.randomState = 0;
+    nextRandom();
+    state.randomState += value;
+    nextRandom();
+}
+
+// For states read from files, the interpreter indexes its caches with PC
+// and the stack with SP without checking them
+bool CHIP8Emulator::isValidState(const MachineState& snapshot)
+{
+    unsigned char frameReady, waitingForKey;
+
+    // Any byte but 0 or 1 is not a bool, read them as bytes
+    std::memcpy(&frameReady, &snapshot.frameReady, 1);
+    std::memcpy(&waitingForKey, &snapshot.waitingForKey, 1);
+
+    return snapshot.PC < MEMORY_SIZE && snapshot.SP <= STACK_LEVEL && frameReady <= 1 && waitingForKey <= 1;
+}
+
+unsigned long long CHIP8Emulator::hashFrame(const FrameRow* rows)
 {
-    instance().reset();
-    instance().load(file);
+    // 64-bit FNV-1a over the packed rows
+    unsigned long long hash = 0xcbf29ce484222325ULL;
 
-    while(true)
-    {
-        instance().runTick();
+    for(int i = 0; i < NUM_LINES; i++)
+        for(int byte = 0; byte < 8; byte++)
+        {
+            hash ^= (rows[i] >> (byte * 8)) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
 
-        if(instance().hasNewFrame())
-            instance().drawFrame();
+    return hash;
+}
 
-        instance().updateKeys();
-    }
+/////////////////////////////////////////////////////////////////////////
+
+unsigned short CHIP8Emulator::fetch()
+{
+    unsigned short instruction = ((unsigned short)state.mem[state.PC]) << 8 | state.mem[state.PC+1];
+    advancePC();
+
+    return instruction;
 }
 
-CHIP8Emulator& CHIP8Emulator::instance()
+void CHIP8Emulator::decodeAndExecute(unsigned short instruction)
 {
-    static CHIP8Emulator singletonInstance;
+    DecodedInstruction decoded = decoder(instruction);
 
-    return singletonInstance;
+    decoded.handler(*this, decoded);
 }
 
-/////////////////////////////////////////////////////////////////////////
+DecodedInstruction CHIP8Emulator::decodedAt(SpecialRegister address)
+{
+    // Instructions at odd addresses straddle two slots and are never cached
+    if(address & 1)
+        return decoder(((unsigned short)state.mem[address]) << 8 | state.mem[(address+1) % MEMORY_SIZE]);
+
+    DecodedInstruction& slot = codeCache().decoded[address / 2];
+
+    if(!slot.handler)
+        slot = decoder(((unsigned short)state.mem[address]) << 8 | state.mem[address+1]);
+
+    return slot;
+}
 
-CHIP8Emulator::CHIP8Emulator()
-    : I(0), PC(PROGRAM_LOCATION), delayTimer(0), soundTimer(0), SP(0), frameReady(false)
+unsigned char CHIP8Emulator::blockAt(SpecialRegister address)
 {
-    V     = new GeneralRegister[NUM_GENERAL_REGISTERS]{};
-    mem   = new unsigned char[MEMORY_SIZE]{};
-    gfx   = new unsigned char[NUM_PIXELS]{};
-    stack = new unsigned short[STACK_LEVEL]{};
-    key   = new unsigned char[NUM_KEYS]{};
-    io    = new NCursesIO();
+    if(address & 1)
+        return 0;
 
-    std::random_device seed;
-    randomGenerator = std::mt19937(seed());
-    dist = std::uniform_int_distribution<RegisterArgument>();
+    unsigned int first = address / 2;
+
+    if(codeCache().blockLength[first])
+        return codeCache().blockLength[first];
+
+    // Extend the block until an instruction that ends it, the maximum
+    // length or the end of memory
+    unsigned int slot = first;
+    while(true)
+    {
+        DecodedInstruction instruction = decodedAt(slot * 2);
+
+        if(instruction.endsBlock || slot - first + 1 == MAX_BLOCK_LENGTH || slot + 1 == NUM_INSTRUCTION_SLOTS)
+            break;
+        slot++;
+    }
+
+    codeCache().blockLength[first] = slot - first + 1;
+
+    return codeCache().blockLength[first];
 }
 
-CHIP8Emulator::CHIP8Emulator(const CHIP8Emulator& other)
-    : I(other.I), PC(other.PC), delayTimer(other.delayTimer), soundTimer(other.soundTimer), 
-      SP(other.SP), randomGenerator(other.randomGenerator), dist(other.dist), frameReady(other.frameReady)
+void CHIP8Emulator::runBody(unsigned char length)
 {
-    V     = new GeneralRegister[NUM_GENERAL_REGISTERS];
-    mem   = new unsigned char[MEMORY_SIZE];
-    gfx   = new unsigned char[NUM_PIXELS];
-    stack = new unsigned short[STACK_LEVEL];
-    key   = new unsigned char[NUM_KEYS];
-    io    = other.io;
+    const DecodedInstruction* instruction = &codeCache().decoded[state.PC / 2];
+    const DecodedInstruction* last = instruction + length - 1;
 
-    std::memcpy(V    , other.V    , sizeof(GeneralRegister) * NUM_GENERAL_REGISTERS);
-    std::memcpy(mem  , other.mem  , sizeof(unsigned char) * MEMORY_SIZE);
-    std::memcpy(gfx  , other.gfx  , sizeof(unsigned char) * NUM_PIXELS);
-    std::memcpy(stack, other.stack, sizeof(unsigned short) * STACK_LEVEL);
-    std::memcpy(key  , other.key  , sizeof(unsigned char) * NUM_KEYS);
+    for(; instruction != last; instruction++)
+    {
+        advancePC();
+        instruction->handler(*this, *instruction);
+    }
 }
 
-CHIP8Emulator::CHIP8Emulator(CHIP8Emulator&& other)
-    : V(other.V), I(other.I), PC(other.PC), mem(other.mem), 
-      gfx(other.gfx), delayTimer(other.delayTimer), 
-      soundTimer(other.soundTimer), stack(other.stack), 
-      SP(other.SP), key(other.key), randomGenerator(other.randomGenerator),
-      dist(other.dist), frameReady(other.frameReady), io(other.io)
+void CHIP8Emulator::runDifferential(CompiledBlock compiled, unsigned char length)
 {
-    other.V     = nullptr;
-    other.mem   = nullptr;
-    other.gfx   = nullptr;
-    other.stack = nullptr;
-    other.key   = nullptr;
-    other.io    = nullptr;
+    MachineState before = state;
+
+    // Native run
+    compiled(state.V, &state.I);
+    setPC(state.PC + (length - 1) * 2);
+
+    MachineState native = state;
+
+    // Rewind and interpret the same body
+    state = before;
+    runBody(length);
+
+    std::ostringstream divergence;
+    divergence << std::hex;
+
+    for(int i = 0; i < NUM_GENERAL_REGISTERS; i++)
+        if(state.V[i] != native.V[i])
+            divergence << " V" << i << "=" << (int)native.V[i] << "/" << (int)state.V[i];
+    if(state.I != native.I)
+        divergence << " I=" << native.I << "/" << state.I;
+    if(state.PC != native.PC)
+        divergence << " PC=" << native.PC << "/" << state.PC;
+    if(std::memcmp(state.mem, native.mem, MEMORY_SIZE))
+        divergence << " mem";
+    if(std::memcmp(state.gfx, native.gfx, sizeof(state.gfx)))
+        divergence << " gfx";
+
+    if(!divergence.str().empty())
+    {
+        std::ostringstream message;
+        message << std::hex << "Recompiled block at 0x" << before.PC
+                << " diverged (recompiled/interpreted):" << divergence.str();
+        throw std::runtime_error(message.str());
+    }
 }
 
-CHIP8Emulator& CHIP8Emulator::operator=(const CHIP8Emulator& other)
+void CHIP8Emulator::invalidateCode(SpecialRegister address, unsigned short length)
 {
-    I               = other.I;
-    PC              = other.PC;
-    delayTimer      = other.delayTimer;
-    soundTimer      = other.soundTimer;
-    SP              = other.SP;
-    randomGenerator = other.randomGenerator;
-    dist            = other.dist;
-    frameReady      = other.frameReady;
-    io              = other.io;
-
-    std::memcpy(V    , other.V    , sizeof(GeneralRegister) * NUM_GENERAL_REGISTERS);
-    std::memcpy(mem  , other.mem  , sizeof(unsigned char) * MEMORY_SIZE);
-    std::memcpy(gfx  , other.gfx  , sizeof(unsigned char) * NUM_PIXELS);
-    std::memcpy(stack, other.stack, sizeof(unsigned short) * STACK_LEVEL);
-    std::memcpy(key  , other.key  , sizeof(unsigned char) * NUM_KEYS);
+    if(length == 0 || address >= MEMORY_SIZE)
+        return;
 
-    return *this;
+    unsigned int last = address + length - 1;
+    if(last >= MEMORY_SIZE)
+        last = MEMORY_SIZE - 1;
+
+    dirtyPages |= (~0ULL << (address / DIRTY_PAGE_SIZE)) & (~0ULL >> (63 - last / DIRTY_PAGE_SIZE));
+
+    if(recompiler)
+        recompiler->invalidate(address, length);
+    if(precompiled)
+        precompiled->invalidate(address, length);
+
+    // Nothing decoded yet, nothing to forget
+    if(!code)
+        return;
+
+    for(unsigned int slot = address / 2; slot <= last / 2; slot++)
+        code->decoded[slot].handler = nullptr;
+
+    // Any block starting up to MAX_BLOCK_LENGTH slots earlier may cover the range
+    unsigned int firstBlock = (address / 2 >= MAX_BLOCK_LENGTH - 1) ? address / 2 - (MAX_BLOCK_LENGTH - 1) : 0;
+    std::memset(&code->blockLength[firstBlock], 0, last / 2 - firstBlock + 1);
+
+    // Loops are judged at their closing jump, up to MAX_IDLE_LOOP slots later
+    unsigned int lastJump = std::min(last / 2 + MAX_IDLE_LOOP - 1, (unsigned int)NUM_INSTRUCTION_SLOTS - 1);
+    std::memset(&code->idleLoop[address / 2], 0, lastJump - address / 2 + 1);
 }
 
-CHIP8Emulator& CHIP8Emulator::operator=(CHIP8Emulator&& other)
+// Every access through I comes here first. Accesses past the end of
+// memory wrap around, as on a 12-bit address bus
+bool CHIP8Emulator::checkMemory(unsigned int address, unsigned int length, bool write)
 {
-    V               = other.V;
-    I               = other.I;
-    PC              = other.PC;
-    mem             = other.mem;
-    gfx             = other.gfx;
-    delayTimer      = other.delayTimer;
-    soundTimer      = other.soundTimer;
-    stack           = other.stack;
-    SP              = other.SP;
-    key             = other.key;
-    randomGenerator = other.randomGenerator;
-    dist            = other.dist;
-    frameReady      = other.frameReady;
-    io              = other.io;
-
-    other.V     = nullptr;
-    other.mem   = nullptr;
-    other.gfx   = nullptr;
-    other.stack = nullptr;
-    other.key   = nullptr;
-    other.io    = nullptr;
+    if(debugger)
+        debugger->access(address % MEMORY_SIZE, length, write, (state.PC - 2) % MEMORY_SIZE);
 
-    return *this;
+    if(length == 0 || address + length <= MEMORY_SIZE)
+        return true;
+
+    raiseFault(FAULT_MEMORY);
+
+    return false;
 }
 
-CHIP8Emulator::~CHIP8Emulator()
+void CHIP8Emulator::raiseFault(GuestFault fault)
 {
-    delete[] V;
-    delete[] mem;
-    delete[] gfx;
-    delete[] stack;
-    delete[] key;
-    delete io;
+    // Handlers run with PC already past the instruction
+    if(!guestFaults)
+        firstFault = (state.PC - 2) % MEMORY_SIZE;
+
+    guestFaults |= fault;
 }
 
-/////////////////////////////////////////////////////////////////////////
+void CHIP8Emulator::updateDelayTimer()
+{
+    if (state.delayTimer > 0)
+        state.delayTimer--;
+}
 
-void CHIP8Emulator::load(const std::string& file)
+void CHIP8Emulator::updateSoundTimer()
 {
-    std::ifstream program(file);
+    if (state.soundTimer > 0)
+        state.soundTimer--;
+}
+
+CodeCache& CHIP8Emulator::codeCache()
+{
+    if(!code)
+        code = new CodeCache();
 
-    program.read((char *)&mem[PROGRAM_LOCATION], 0xe00);
+    return *code;
 }
 
-void CHIP8Emulator::runTick()
+RegisterArgument CHIP8Emulator::nextRandom()
 {
-    decodeAndExecute(fetch());
-    updateTimers();
+    // PCG32, XSH RR output
+    unsigned long long old = state.randomState;
+    state.randomState = old * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    unsigned int xorshifted = ((old >> 18) ^ old) >> 27;
+    unsigned int rotation = old >> 59;
+    unsigned int value = (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+
+    return value >> 24;
 }
 
-bool CHIP8Emulator::hasNewFrame() const
+void CHIP8Emulator::advancePC()
 {
-    return frameReady;
+    setPC(state.PC + 2);
 }
 
-void CHIP8Emulator::drawFrame()
+void CHIP8Emulator::setPC(SpecialRegister newPC)
 {
-    frameReady = false;
-    io->draw(gfx);
+    state.PC = newPC % MEMORY_SIZE;
 }
 
-void CHIP8Emulator::updateKeys()
+/////////////////////////////////////////////////////////////////////////
+
+void CHIP8Emulator::stackPush(unsigned short value)
 {
+    state.stack[state.SP++] = value;
+}
 
+unsigned short CHIP8Emulator::stackPop()
+{
+    return state.stack[--state.SP];
 }
 
-void CHIP8Emulator::reset()
+bool CHIP8Emulator::stackIsFull()
 {
-    I          = 0;
-    PC         = PROGRAM_LOCATION;
-    delayTimer = 0;
-    soundTimer = 0;
-    SP         = 0;
+    return (state.SP >= STACK_LEVEL);
+}
 
-    std::memset(V, 0, NUM_GENERAL_REGISTERS);
-    std::memset(mem, 0, MEMORY_SIZE);
-    std::memset(gfx, 0, NUM_PIXELS);
-    std::memset(stack, 0, STACK_LEVEL);
-    std::memset(key, 0, NUM_KEYS);
+bool CHIP8Emulator::stackIsEmpty()
+{
+    return (state.SP == 0);
 }
 
 /////////////////////////////////////////////////////////////////////////
 
-unsigned short CHIP8Emulator::fetch()
+Decoder CHIP8Emulator::decoderFor(QuirkProfile profile)
 {
-    unsigned short instruction = ((unsigned short)mem[PC]) << 8 | mem[PC+1];
-    advancePC();
+    switch(profile)
+    {
+    case QuirkProfile::Default:
+        return &CHIP8Emulator::decode<DefaultQuirks>;
+    case QuirkProfile::CosmacVIP:
+        return &CHIP8Emulator::decode<CosmacVipQuirks>;
+    case QuirkProfile::Chip48:
+        return &CHIP8Emulator::decode<Chip48Quirks>;
+    case QuirkProfile::SuperChip:
+        return &CHIP8Emulator::decode<SuperChipQuirks>;
+    case QuirkProfile::XoChip:
+        return &CHIP8Emulator::decode<XoChipQuirks>;
+    }
 
-    return instruction;
+    return &CHIP8Emulator::decode<DefaultQuirks>;
 }
 
-void CHIP8Emulator::decodeAndExecute(unsigned short instruction)
+template<class Quirks>
+DecodedInstruction CHIP8Emulator::decode(unsigned short instruction)
 {
+    DecodedInstruction decoded;
+
+    decoded.handler = &CHIP8Emulator::handleIgnore;
+    decoded.address = ADDRESS(instruction);
+    decoded.x       = REGISTER_X(instruction);
+    decoded.y       = REGISTER_Y(instruction);
+    decoded.n       = SECOND_ARG(instruction);
+    decoded.nibble  = THIRD_ARG(instruction);
+    decoded.endsBlock = isBlockTerminator(instruction);
+    decoded.family  = Profiler::familyOf(instruction);
+
     switch(instruction >> 12)
     {
     case 0x0:
-        basicOperations(ADDRESS(instruction));
+        decoded.handler = decodeBasicOperations(ADDRESS(instruction));
         break;
     case 0x1:
-        jump(ADDRESS(instruction));
+        decoded.handler = &CHIP8Emulator::handleAddress<&CHIP8Emulator::jump>;
         break;
     case 0x2:
-        call(ADDRESS(instruction));
+        decoded.handler = &CHIP8Emulator::handleAddress<&CHIP8Emulator::call>;
         break;
     case 0x3:
-        skipEqual(REGISTER_X(instruction), SECOND_ARG(instruction));
+        decoded.handler = &CHIP8Emulator::handleXN<&CHIP8Emulator::skipEqual>;
         break;
     case 0x4:
-        skipNotEqual(REGISTER_X(instruction), SECOND_ARG(instruction));
+        decoded.handler = &CHIP8Emulator::handleXN<&CHIP8Emulator::skipNotEqual>;
         break;
     case 0x5:
-        skipRegisterEqual(REGISTER_X(instruction), REGISTER_Y(instruction));
+        decoded.handler = &CHIP8Emulator::handleXY<&CHIP8Emulator::skipRegisterEqual>;
         break;
     case 0x6:
-        movValue(REGISTER_X(instruction), SECOND_ARG(instruction));
+        decoded.handler = &CHIP8Emulator::handleXN<&CHIP8Emulator::movValue>;
         break;
     case 0x7:
-        addValue(REGISTER_X(instruction), SECOND_ARG(instruction));
+        decoded.handler = &CHIP8Emulator::handleXN<&CHIP8Emulator::addValue>;
         break;
     case 0x8:
-        registerOperations(REGISTER_X(instruction), REGISTER_Y(instruction), THIRD_ARG(instruction));
+        decoded.handler = decodeRegisterOperations<Quirks>(THIRD_ARG(instruction));
         break;
     case 0x9:
-        skipRegisterNotEqual(REGISTER_X(instruction), REGISTER_Y(instruction));
+        decoded.handler = &CHIP8Emulator::handleXY<&CHIP8Emulator::skipRegisterNotEqual>;
         break;
     case 0xa:
-        movAddress(ADDRESS(instruction));
+        decoded.handler = &CHIP8Emulator::handleAddress<&CHIP8Emulator::movAddress>;
         break;
     case 0xb:
-        jumpAddress(ADDRESS(instruction));
+        decoded.handler = &CHIP8Emulator::handleAddress<&CHIP8Emulator::jumpAddress<Quirks>>;
         break;
     case 0xc:
-        rand(REGISTER_X(instruction), SECOND_ARG(instruction));
+        decoded.handler = &CHIP8Emulator::handleXN<&CHIP8Emulator::rand>;
         break;
     case 0xd:
-        draw(REGISTER_X(instruction), REGISTER_Y(instruction), THIRD_ARG(instruction));
+        decoded.handler = &CHIP8Emulator::handleXYN<&CHIP8Emulator::draw<Quirks>>;
         break;
     case 0xe:
-        skipByKey(REGISTER_X(instruction), SECOND_ARG(instruction));
+        decoded.handler = decodeSkipByKey(SECOND_ARG(instruction));
         break;
     case 0xf:
-        specialOperations(REGISTER_X(instruction), SECOND_ARG(instruction));
+        decoded.handler = decodeSpecialOperations<Quirks>(SECOND_ARG(instruction));
         break;
     }
+
+    return decoded;
 }
 
-void CHIP8Emulator::updateTimers()
+InstructionHandler CHIP8Emulator::decodeBasicOperations(AddressArgument op)
 {
-    updateDelayTimer();
-    updateSoundTimer();
+    switch(op)
+    {
+    case 0xe0:
+        return &CHIP8Emulator::handleNone<&CHIP8Emulator::clear>;
+    case 0xee:
+        return &CHIP8Emulator::handleNone<&CHIP8Emulator::ret>;
+    }
+
+    return &CHIP8Emulator::handleIgnore;
 }
 
-void CHIP8Emulator::updateDelayTimer()
+template<class Quirks>
+InstructionHandler CHIP8Emulator::decodeRegisterOperations(RegisterArgument op)
 {
-    if (delayTimer > 0)
-        delayTimer--;
+    switch(op)
+    {
+    case 0x0:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerMov>;
+    case 0x1:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerOr>;
+    case 0x2:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerAnd>;
+    case 0x3:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerXor>;
+    case 0x4:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerAdd>;
+    case 0x5:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerSub>;
+    case 0x6:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerShiftRight<Quirks>>;
+    case 0x7:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerMinus>;
+    case 0xe:
+        return &CHIP8Emulator::handleXY<&CHIP8Emulator::registerShiftLeft<Quirks>>;
+    }
+
+    return &CHIP8Emulator::handleIgnore;
 }
 
-void CHIP8Emulator::updateSoundTimer()
+InstructionHandler CHIP8Emulator::decodeSkipByKey(RegisterArgument op)
 {
-    if (soundTimer > 0)
-        soundTimer--;
+    switch(op)
+    {
+    case 0x9e:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::skipPressed>;
+    case 0xa1:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::skipNotPressed>;
+    }
+
+    return &CHIP8Emulator::handleIgnore;
 }
 
-void CHIP8Emulator::advancePC()
+template<class Quirks>
+InstructionHandler CHIP8Emulator::decodeSpecialOperations(RegisterArgument op)
 {
-    setPC(PC + 2);
+    switch(op)
+    {
+    case 0x07:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::getDelayTimer>;
+    case 0x0a:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::waitForKey>;
+    case 0x15:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::setDelayTimer>;
+    case 0x18:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::setSoundTimer>;
+    case 0x1e:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::addIndex>;
+    case 0x29:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::getSpriteAddress>;
+    case 0x33:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::storeDecimal>;
+    case 0x55:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::storeRegisters<Quirks>>;
+    case 0x65:
+        return &CHIP8Emulator::handleX<&CHIP8Emulator::fillRegisters<Quirks>>;
+    }
+
+    return &CHIP8Emulator::handleIgnore;
 }
 
-void CHIP8Emulator::setPC(SpecialRegister newPC)
+bool CHIP8Emulator::isBlockTerminator(unsigned short instruction)
 {
-    PC = newPC % MEMORY_SIZE;
+    switch(instruction >> 12)
+    {
+    case 0x0:
+        return ADDRESS(instruction) == 0xee;
+    case 0x1:
+    case 0x2:
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+    case 0xb:
+    case 0xd:
+    case 0xe:
+        return true;
+    case 0xf:
+        switch(SECOND_ARG(instruction))
+        {
+        case 0x0a:
+        case 0x33:
+        case 0x55:
+            return true;
+        }
+        return false;
+    }
+
+    return false;
 }
 
 /////////////////////////////////////////////////////////////////////////
 
-void CHIP8Emulator::stackPush(unsigned short value)
+void CHIP8Emulator::handleIgnore(CHIP8Emulator& emulator, const DecodedInstruction& instruction)
 {
-    stack[SP++] = value;
+
 }
 
-unsigned short CHIP8Emulator::stackPop()
+template<void (CHIP8Emulator::*method)()>
+void CHIP8Emulator::handleNone(CHIP8Emulator& emulator, const DecodedInstruction& instruction)
 {
-    return stack[SP--];
+    (emulator.*method)();
 }
 
-bool CHIP8Emulator::stackIsFull()
+template<void (CHIP8Emulator::*method)(AddressArgument)>
+void CHIP8Emulator::handleAddress(CHIP8Emulator& emulator, const DecodedInstruction& instruction)
 {
-    return (SP >= STACK_LEVEL);
+    (emulator.*method)(instruction.address);
 }
 
-bool CHIP8Emulator::stackIsEmpty()
+template<void (CHIP8Emulator::*method)(RegisterIndex)>
+void CHIP8Emulator::handleX(CHIP8Emulator& emulator, const DecodedInstruction& instruction)
 {
-    return (SP == 0);
+    (emulator.*method)(instruction.x);
 }
 
-/////////////////////////////////////////////////////////////////////////
+template<void (CHIP8Emulator::*method)(RegisterIndex, RegisterArgument)>
+void CHIP8Emulator::handleXN(CHIP8Emulator& emulator, const DecodedInstruction& instruction)
+{
+    (emulator.*method)(instruction.x, instruction.n);
+}
 
-void CHIP8Emulator::basicOperations(AddressArgument op)
+template<void (CHIP8Emulator::*method)(RegisterIndex, RegisterIndex)>
+void CHIP8Emulator::handleXY(CHIP8Emulator& emulator, const DecodedInstruction& instruction)
 {
-    switch(op)
-    {
-    case 0xe0:
-        clear();
-        break;
-    case 0xee:
-        ret();
-        break;
-    }
+    (emulator.*method)(instruction.x, instruction.y);
+}
+
+template<void (CHIP8Emulator::*method)(RegisterIndex, RegisterIndex, RegisterArgument)>
+void CHIP8Emulator::handleXYN(CHIP8Emulator& emulator, const DecodedInstruction& instruction)
+{
+    (emulator.*method)(instruction.x, instruction.y, instruction.nibble);
 }
 
+/////////////////////////////////////////////////////////////////////////
+
 void CHIP8Emulator::clear()
 {
-    frameReady = true;
-    std::memset(gfx, 0, NUM_PIXELS);
+    state.frameReady = true;
+
+    // Only lit pixels change
+    for(int i = 0; i < NUM_LINES; i++)
+    {
+        dirty[i] |= state.gfx[i];
+        state.gfx[i] = 0;
+    }
 }
 
 void CHIP8Emulator::ret()
 {
     if(!stackIsEmpty())
         setPC(stackPop());
+    else
+        raiseFault(FAULT_STACK_UNDERFLOW);
 }
 
 void CHIP8Emulator::jump(AddressArgument address)
@@ -347,268 +1446,206 @@ void CHIP8Emulator::call(AddressArgument address)
 {
     if(!stackIsFull())
     {
-        stackPush(PC);
+        stackPush(state.PC);
         setPC(address);
     }
+    else
+        raiseFault(FAULT_STACK_OVERFLOW);
 }
 
 void CHIP8Emulator::skipEqual(RegisterIndex x, RegisterArgument n)
 {
-    if(V[x] == n)
+    if(state.V[x] == n)
         advancePC();
 }
 
 void CHIP8Emulator::skipNotEqual(RegisterIndex x, RegisterArgument n)
 {
-    if(V[x] != n)
+    if(state.V[x] != n)
         advancePC();
 }
 
 void CHIP8Emulator::skipRegisterEqual(RegisterIndex x, RegisterIndex y)
 {
-    if(V[x] == V[y])
+    if(state.V[x] == state.V[y])
         advancePC();
 }
 
 void CHIP8Emulator::movValue(RegisterIndex x, RegisterArgument n)
 {
-    V[x] = n;
+    RegisterInstructions::movValue(state.V, x, n);
 }
 
 void CHIP8Emulator::addValue(RegisterIndex x, RegisterArgument n)
 {
-    V[x] += n;
-}
-
-void CHIP8Emulator::registerOperations(RegisterIndex x, RegisterIndex y, RegisterArgument op)
-{
-    switch(op)
-    {
-    case 0x0:
-        registerMov(x, y);
-        break;
-    case 0x1:
-        registerOr(x, y);
-        break;
-    case 0x2:
-        registerAnd(x, y);
-        break;
-    case 0x3:
-        registerXor(x, y);
-        break;
-    case 0x4:
-        registerAdd(x, y);
-        break;
-    case 0x5:
-        registerSub(x, y);
-        break;
-    case 0x6:
-        registerShiftRight(x, y);
-        break;
-    case 0x7:
-        registerMinus(x, y);
-        break;
-    case 0xe:
-        registerShiftLeft(x, y);
-        break;
-    }
+    RegisterInstructions::addValue(state.V, x, n);
 }
 
 void CHIP8Emulator::registerMov(RegisterIndex x, RegisterIndex y)
 {
-    V[x] = V[y];
+    RegisterInstructions::registerMov(state.V, x, y);
 }
 
 void CHIP8Emulator::registerOr(RegisterIndex x, RegisterIndex y)
 {
-    V[x] |= V[y];
+    RegisterInstructions::registerOr(state.V, x, y);
 }
 
 void CHIP8Emulator::registerAnd(RegisterIndex x, RegisterIndex y)
 {
-    V[x] &= V[y];
+    RegisterInstructions::registerAnd(state.V, x, y);
 }
 
 void CHIP8Emulator::registerXor(RegisterIndex x, RegisterIndex y)
 {
-    V[x] ^= V[y];
+    RegisterInstructions::registerXor(state.V, x, y);
 }
 
 void CHIP8Emulator::registerAdd(RegisterIndex x, RegisterIndex y)
 {
-    unsigned short value = ((unsigned short)V[x]) + ((unsigned short)V[y]);
-    
-    V[0xf] = (value > 0xffff);
-    value &= 0xffff;
-    V[x] = value;
+    RegisterInstructions::registerAdd(state.V, x, y);
 }
 
 void CHIP8Emulator::registerSub(RegisterIndex x, RegisterIndex y)
 {
-    unsigned short value = ((unsigned short)V[x]) - ((unsigned short)V[y]);
-    
-    V[0xf] = (value <= 0xffff);
-    value &= 0xffff;
-    V[x] = value;
+    RegisterInstructions::registerSub(state.V, x, y);
 }
 
+template<class Quirks>
 void CHIP8Emulator::registerShiftRight(RegisterIndex x, RegisterIndex y)
 {
-    V[0xf] = V[x] & 0x01;
-    V[x] >>= 1;
+    RegisterInstructions::registerShiftRight<Quirks::shiftUsesVY>(state.V, x, y);
 }
 
 void CHIP8Emulator::registerMinus(RegisterIndex x, RegisterIndex y)
 {
-    unsigned short value = ((unsigned short)V[y]) - ((unsigned short)V[x]);
-    
-    V[0xf] = (value <= 0xffff);
-    value &= 0xffff;
-    V[x] = value;
+    RegisterInstructions::registerMinus(state.V, x, y);
 }
 
+template<class Quirks>
 void CHIP8Emulator::registerShiftLeft(RegisterIndex x, RegisterIndex y)
 {
-    V[0xf] = V[x] & 0x80;
-    V[x] <<= 1;
+    RegisterInstructions::registerShiftLeft<Quirks::shiftUsesVY>(state.V, x, y);
 }
 
 void CHIP8Emulator::skipRegisterNotEqual(RegisterIndex x, RegisterIndex y)
 {
-    if(V[x] != V[y])
+    if(state.V[x] != state.V[y])
         advancePC();
 }
 
 void CHIP8Emulator::movAddress(AddressArgument address)
 {
-    I = address;
+    RegisterInstructions::movAddress(&state.I, address);
 }
 
+template<class Quirks>
 void CHIP8Emulator::jumpAddress(AddressArgument address)
 {
-    setPC(address + V[0]);
+    // BXNN on CHIP-48 and SUPER-CHIP
+    if constexpr(Quirks::jumpUsesVX)
+        setPC(address + state.V[REGISTER_X(address)]);
+    else
+        setPC(address + state.V[0]);
 }
 
 void CHIP8Emulator::rand(RegisterIndex x, RegisterArgument n)
 {
-    V[x] = dist(randomGenerator) & n;
+    state.V[x] = nextRandom() & n;
 }
 
+template<class Quirks>
 void CHIP8Emulator::draw(RegisterIndex x, RegisterIndex y, RegisterArgument n)
 {
-    frameReady = true;
-
-    GeneralRegister xPos = V[x] % NUM_COLUMNS;
-    GeneralRegister yPos = V[y] % NUM_LINES;
-    V[0xf] = 0;
-
-    // For each row
-    for(int i = 0; (i < n) && (yPos < NUM_LINES); i++)
+    if(profiler)
     {
-        // Get sprite row
-        unsigned char spriteRow = mem[I+i];
-        // For each column
-        for(int j = 0; (j < 8) && (xPos < NUM_COLUMNS); j++)
-        {
-            // If bit is on
-            if(spriteRow & 1)
-            {
-                // Detect collision
-                if(gfx[xPos + (yPos * NUM_COLUMNS)])
-                    V[0xf] = 1;
-                // Flip pixel
-                gfx[xPos + (yPos * NUM_COLUMNS)] = !gfx[xPos + (yPos * NUM_COLUMNS)];
-            }
-            // Advance to next bit and next position
-            spriteRow >>= 1;
-            xPos++;
-        }
-        // Advance to next position
-        xPos = V[x] % NUM_COLUMNS;
-        yPos++;
+        ScopedTimer timer(profiler->spriteTime());
+        drawSprite<Quirks>(x, y, n);
     }
+    else
+        drawSprite<Quirks>(x, y, n);
 }
 
-void CHIP8Emulator::skipByKey(RegisterIndex x, RegisterArgument op)
+template<class Quirks>
+void CHIP8Emulator::drawSprite(RegisterIndex x, RegisterIndex y, RegisterArgument n)
 {
-    switch(op)
+    state.frameReady = true;
+
+    GeneralRegister xPos = state.V[x] % NUM_COLUMNS;
+    GeneralRegister yPos = state.V[y] % NUM_LINES;
+    state.V[0xf] = 0;
+
+    checkMemory(state.I, n, false);
+
+    // For each row
+    for(int i = 0; (i < n) && (Quirks::wrapSprites || yPos < NUM_LINES); i++)
     {
-    case 0x9e:
-        skipPressed(x);
-        break;
-    case 0xa1:
-        skipNotPressed(x);
-        break;
+        FrameRow spriteRow = state.mem[(state.I + i) % MEMORY_SIZE];
+
+        // Place the sprite row, bits past the right edge are shifted out
+        // or come back in on the left
+        if constexpr(Quirks::wrapSprites)
+            spriteRow = (spriteRow << xPos) | (spriteRow >> ((NUM_COLUMNS - xPos) % NUM_COLUMNS));
+        else
+            spriteRow <<= xPos;
+        // Detect collision
+        if(state.gfx[yPos] & spriteRow)
+            state.V[0xf] = 1;
+        // Flip pixels
+        state.gfx[yPos] ^= spriteRow;
+        dirty[yPos] |= spriteRow;
+        // Advance to next position
+        yPos = Quirks::wrapSprites ? (yPos + 1) % NUM_LINES : yPos + 1;
     }
 }
 
 void CHIP8Emulator::skipPressed(RegisterIndex x)
 {
-
+    if(state.keys & (1 << (state.V[x] & 0xf)))
+        advancePC();
 }
 
 void CHIP8Emulator::skipNotPressed(RegisterIndex x)
 {
-
-}
-
-void CHIP8Emulator::specialOperations(RegisterIndex x, RegisterArgument op)
-{
-    switch(op)
-    {
-    case 0x07:
-        getDelayTimer(x);
-        break;
-    case 0x0a:
-        waitForKey(x);
-        break;
-    case 0x15:
-        setDelayTimer(x);
-        break;
-    case 0x18:
-        setSoundTimer(x);
-        break;
-    case 0x1e:
-        addIndex(x);
-        break;
-    case 0x29:
-        getSpriteAddress(x);
-        break;
-    case 0x33:
-        storeDecimal(x);
-        break;
-    case 0x55:
-        storeRegisters(x);
-        break;
-    case 0x65:
-        fillRegisters(x);
-        break;
-    }
+    if(!(state.keys & (1 << (state.V[x] & 0xf))))
+        advancePC();
 }
 
 void CHIP8Emulator::getDelayTimer(RegisterIndex x)
 {
-    V[x] = delayTimer;
+    state.V[x] = state.delayTimer;
 }
 
 void CHIP8Emulator::waitForKey(RegisterIndex x)
 {
-
+    // Keys already held when the wait started do not count
+    if(state.keyPresses)
+    {
+        state.V[x] = __builtin_ctz(state.keyPresses);
+        state.keyPresses = 0;
+        state.waitingForKey = false;
+    }
+    else
+    {
+        // Come back to this instruction once the keys were polled again
+        setPC(state.PC - 2);
+        state.waitingForKey = true;
+    }
 }
 
 void CHIP8Emulator::setDelayTimer(RegisterIndex x)
 {
-    delayTimer = V[x];
+    state.delayTimer = state.V[x];
 }
 
 void CHIP8Emulator::setSoundTimer(RegisterIndex x)
 {
-    soundTimer = V[x];
+    state.soundTimer = state.V[x];
 }
 
 void CHIP8Emulator::addIndex(RegisterIndex x)
 {
-    I += V[x];
+    RegisterInstructions::addIndex(state.V, &state.I, x);
 }
 
 void CHIP8Emulator::getSpriteAddress(RegisterIndex x)
@@ -618,21 +1655,52 @@ void CHIP8Emulator::getSpriteAddress(RegisterIndex x)
 
 void CHIP8Emulator::storeDecimal(RegisterIndex x)
 {
-    GeneralRegister value = V[x];
+    unsigned char digits[3];
+    GeneralRegister value = state.V[x];
 
     for(int i = 0; i < 3; i++)
     {
-        mem[I+i] = value % 10;
+        digits[i] = value % 10;
         value /= 10;
     }
+
+    if(checkMemory(state.I, 3, true))
+    {
+        std::memcpy(&state.mem[state.I], digits, 3);
+        invalidateCode(state.I, 3);
+    }
+    else
+        writeMemory(state.I, digits, 3);
 }
 
+template<class Quirks>
 void CHIP8Emulator::storeRegisters(RegisterIndex x)
 {
-    std::memcpy(&mem[I], V, x);
+    if(checkMemory(state.I, x, true))
+    {
+        std::memcpy(&state.mem[state.I], state.V, x);
+        invalidateCode(state.I, x);
+    }
+    else
+        writeMemory(state.I, state.V, x);
+
+    if constexpr(Quirks::memory == MEMORY_ADD_X)
+        state.I += x;
+    else if constexpr(Quirks::memory == MEMORY_ADD_X_PLUS_ONE)
+        state.I += x + 1;
 }
 
+template<class Quirks>
 void CHIP8Emulator::fillRegisters(RegisterIndex x)
 {
-    std::memcpy(V, &mem[I], x);
+    if(checkMemory(state.I, x, false))
+        std::memcpy(state.V, &state.mem[state.I], x);
+    else
+        for(RegisterIndex i = 0; i < x; i++)
+            state.V[i] = state.mem[(state.I + i) % MEMORY_SIZE];
+
+    if constexpr(Quirks::memory == MEMORY_ADD_X)
+        state.I += x;
+    else if constexpr(Quirks::memory == MEMORY_ADD_X_PLUS_ONE)
+        state.I += x + 1;
 }
\ No newline at end of file
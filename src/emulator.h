@@ -1,9 +1,13 @@
 #ifndef _EMULATOR_H
+#define _EMULATOR_H
 
 #include "io.h"
+#include "quirks.h"
+#include <cassert>
+#include <cstring>
+#include <iosfwd>
 #include <string>
-#include <random>
-#include <functional>
+#include <type_traits>
 
 typedef unsigned char GeneralRegister;
 typedef unsigned short SpecialRegister;
@@ -12,15 +16,147 @@ typedef unsigned char RegisterIndex;
 typedef unsigned char RegisterArgument;
 typedef unsigned short AddressArgument;
 
+#define NUM_GENERAL_REGISTERS 16
+#define MEMORY_SIZE 4096
+#define STACK_LEVEL 16
+#define DEFAULT_INSTRUCTIONS_PER_SECOND 700
+#define MAX_IDLE_LOOP 16            // Instructions in a busy-wait loop idle skipping looks at
+
+class CHIP8Emulator;
+class X86Recompiler;
+class PrecompiledCode;
+class Profiler;
+class Recorder;
+class Coverage;
+class Debugger;
+struct DecodedInstruction;
+
+enum class ExecutionMode
+{
+    Interpreter,    // Cached decode and basic blocks only
+    Recompiler,     // Hot blocks run as native x86-64 code
+    Differential    // Recompiled blocks checked against the interpreter
+};
+
+/* Why a run*() call returned */
+enum class StopReason
+{
+    BudgetExhausted,    // Ran the whole budget
+    FrameReady,         // A frame is waiting to be presented
+    WaitingForKey,      // FX0A needs a key, the keys must be polled before it can go on
+    Breakpoint          // The predicate given to runUntil() held, or the debugger stopped
+};
+
+/* Guest errors the emulator survives, reported for fuzzing and diagnostics */
+enum GuestFault
+{
+    FAULT_STACK_OVERFLOW  = 1,      // 2NNN with every level in use, the call is ignored
+    FAULT_STACK_UNDERFLOW = 2,      // 00EE with nothing to return to, it is ignored
+    FAULT_MEMORY          = 4       // I + n past the end of memory, the access wraps around
+};
+
+typedef void (*InstructionHandler)(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+typedef void (*CompiledBlock)(GeneralRegister* V, SpecialRegister* I);
+typedef DecodedInstruction (*Decoder)(unsigned short instruction);
+
+struct DecodedInstruction
+{
+    InstructionHandler handler;     // Null when the slot must be decoded again
+    AddressArgument address;        // NNN
+    RegisterIndex x;                // X
+    RegisterIndex y;                // Y
+    RegisterArgument n;             // NN
+    RegisterArgument nibble;        // N
+    bool endsBlock;                 // Branches, skips, draws, key waits and memory writes
+    unsigned char family;           // OpcodeFamily, for the profiler
+};
+
+/* All guest state in one block, copying a machine is a single memcpy */
+struct alignas(64) MachineState
+{
+    /* Memory */
+    unsigned char mem[MEMORY_SIZE];
+    FrameRow gfx[DISPLAY_LINES];
+
+    /* Registers */
+    GeneralRegister V[NUM_GENERAL_REGISTERS];
+    SpecialRegister I;
+    SpecialRegister PC;
+
+    /* Stack */
+    unsigned short stack[STACK_LEVEL];
+    SpecialRegister SP;
+
+    /* Timers */
+    Timer delayTimer;
+    Timer soundTimer;
+
+    /* Keypad, one bit per key */
+    unsigned short keys;
+    unsigned short keyPresses;      // Went down at the last poll, FX0A takes them
+
+    /* A DXYN or 00E0 ran since the last presented frame */
+    bool frameReady;
+
+    /* FX0A found no key, the CPU is halted until the next poll */
+    bool waitingForKey;
+
+    /* Random number generator (PCG32) */
+    unsigned long long randomState;
+
+    /* Instructions executed since reset */
+    unsigned long long cycles;
+};
+
+static_assert(std::is_trivially_copyable<MachineState>::value, "MachineState must stay trivially copyable");
+
+/* A busy-wait loop seen to repeat unchanged: each block of one iteration
+   with the registers it starts with, so later slices that find the loop
+   where it left off are replayed by arithmetic */
+struct IdleLoop
+{
+    unsigned char blocks;                                   // 0 while no loop is parked
+    SpecialRegister jump;                                   // Closing 1NNN, whose verdict the code cache keeps
+    unsigned long long period;                              // Cycles per iteration
+    SpecialRegister pc[MAX_IDLE_LOOP];
+    unsigned char length[MAX_IDLE_LOOP];
+    GeneralRegister V[MAX_IDLE_LOOP][NUM_GENERAL_REGISTERS];
+    SpecialRegister I[MAX_IDLE_LOOP];
+
+    /* Registers FX07 loads and that are only compared with constants, and
+       which of them each block loads. Any delay timer those constants
+       cannot tell from the recorded one runs the same iteration */
+    unsigned short timerRegisters;
+    unsigned short timerLoads[MAX_IDLE_LOOP];
+    unsigned char constants[MAX_IDLE_LOOP];
+    unsigned char numConstants;
+    Timer delayTimer;
+
+    /* EX9E and EXA1 read the keypad, the loop stays parked while it is unchanged */
+    bool readsKeys;
+    unsigned short keys;
+};
+
+/* Host-side caches derived from mem, rebuilt on demand */
+struct CodeCache
+{
+    /* Decoded instructions, one slot per aligned instruction */
+    DecodedInstruction decoded[MEMORY_SIZE / 2];
+
+    /* Length in instructions of the basic block starting at each slot, 0 if unknown */
+    unsigned char blockLength[MEMORY_SIZE / 2];
+
+    /* For each backward jump, whether the loop it closes can only touch
+       registers and timers: 0 unknown, 1 yes, 2 no, 3 yes but it cannot
+       be parked across slices */
+    unsigned char idleLoop[MEMORY_SIZE / 2];
+};
+
 class CHIP8Emulator
 {
 public:
-    /* Static methods */
-    static void run(const std::string& file);
-    static CHIP8Emulator& instance();
-
     /* Constructors, operators, and destructor */
-    CHIP8Emulator();
+    explicit CHIP8Emulator(IO& io);
     CHIP8Emulator(const CHIP8Emulator& other);
     CHIP8Emulator(CHIP8Emulator&& other);
     CHIP8Emulator& operator=(const CHIP8Emulator& other);
@@ -30,19 +166,82 @@ public:
     /* Instance methods */
     void load(const std::string& file);
     void runTick();
+    unsigned int runBlock();
+    unsigned long runCycles(unsigned long cycles);
+    StopReason runFor(unsigned long cycles);
+    StopReason runUntilFrame(unsigned long cycles = DEFAULT_INSTRUCTIONS_PER_SECOND);
+    template<class Predicate>
+    StopReason runUntil(Predicate breakpoint, unsigned long cycles);
+    void updateTimers();
+    template<class Backend>
+    void updateTimers(Backend& io);
+    unsigned long long cycleCount() const;
+    unsigned long long skippedCycleCount() const;
+    unsigned short nextInstruction() const;
+    unsigned long long frameHash() const;
     bool hasNewFrame() const;
     void drawFrame();
+    template<class Backend>
+    void drawFrame(Backend& io);
     void updateKeys();
+    template<class Backend>
+    void updateKeys(Backend& io);
     void reset();
+    void setExecutionMode(ExecutionMode mode);
+    ExecutionMode executionMode() const;
+    const MachineState& machineState() const;
+    void restoreState(const MachineState& snapshot);
+    void restoreDirtyPages(const MachineState& snapshot);
+    void writeMemory(SpecialRegister address, const unsigned char* data, unsigned short length);
+    void saveState(std::ostream& out) const;
+    void loadState(std::istream& in);
+    void setProfiler(Profiler* profiler);
+    void setRecorder(Recorder* recorder);
+    void setCoverage(Coverage* coverage);
+    void setDebugger(Debugger* debugger);
+    unsigned char faults() const;
+    SpecialRegister faultAddress() const;
+    void seed(unsigned long long value);
+    void setIdleSkipping(bool enabled);
+    void setQuirkProfile(QuirkProfile profile);
+    QuirkProfile quirkProfile() const;
+
+    /* Static methods */
+    static unsigned long long hashFrame(const FrameRow* rows);
+    static bool isBlockTerminator(unsigned short instruction);
+    static bool isValidState(const MachineState& snapshot);
 private:
     /* Auxiliary methods */
     unsigned short fetch();
     void decodeAndExecute(unsigned short instruction);
-    void updateTimers();
+    DecodedInstruction decodedAt(SpecialRegister address);
+    unsigned char blockAt(SpecialRegister address);
+    void runBody(unsigned char length);
+    void runDifferential(CompiledBlock code, unsigned char length);
+    void invalidateCode(SpecialRegister address, unsigned short length);
+    bool checkMemory(unsigned int address, unsigned int length, bool write);
+    void raiseFault(GuestFault fault);
+    void armPrecompiled();
+    void runBlock(unsigned char length);
+    template<class Stop>
+    StopReason runBlocks(unsigned long long end, Stop stop, StopReason reason);
+    template<class Stop>
+    StopReason debugBlocks(unsigned long long end, Stop stop, StopReason reason);
     void updateDelayTimer();
     void updateSoundTimer();
     void advancePC();
     void setPC(SpecialRegister newPC);
+    CodeCache& codeCache();
+    RegisterArgument nextRandom();
+    template<class Quirks>
+    void drawSprite(RegisterIndex x, RegisterIndex y, RegisterArgument n);
+    unsigned int traceBlock(unsigned char length);
+    bool isIdleLoop(SpecialRegister head, SpecialRegister jump);
+    void skipIdleLoop(SpecialRegister block, unsigned long long end);
+    bool parkIdleLoop(SpecialRegister head, SpecialRegister jump, const IdleLoop& iteration);
+    void resumeIdleLoop(unsigned long long end);
+    bool sameTimerClass(Timer value) const;
+    void skipTo(unsigned long long cycle);
 
     /* Stack operations */
     void stackPush(unsigned short value);
@@ -50,8 +249,33 @@ private:
     bool stackIsFull();
     bool stackIsEmpty();
 
+    /* Decoding, one instantiation per quirk profile */
+    static Decoder decoderFor(QuirkProfile profile);
+    template<class Quirks>
+    static DecodedInstruction decode(unsigned short instruction);
+    static InstructionHandler decodeBasicOperations(AddressArgument op);            // 0***
+    template<class Quirks>
+    static InstructionHandler decodeRegisterOperations(RegisterArgument op);        // 8XY*
+    static InstructionHandler decodeSkipByKey(RegisterArgument op);                 // EX**
+    template<class Quirks>
+    static InstructionHandler decodeSpecialOperations(RegisterArgument op);         // FX**
+
+    /* Handler adapters, one per operand layout */
+    static void handleIgnore(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+    template<void (CHIP8Emulator::*method)()>
+    static void handleNone(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+    template<void (CHIP8Emulator::*method)(AddressArgument)>
+    static void handleAddress(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+    template<void (CHIP8Emulator::*method)(RegisterIndex)>
+    static void handleX(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+    template<void (CHIP8Emulator::*method)(RegisterIndex, RegisterArgument)>
+    static void handleXN(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+    template<void (CHIP8Emulator::*method)(RegisterIndex, RegisterIndex)>
+    static void handleXY(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+    template<void (CHIP8Emulator::*method)(RegisterIndex, RegisterIndex, RegisterArgument)>
+    static void handleXYN(CHIP8Emulator& emulator, const DecodedInstruction& instruction);
+
     /* Instruction methods */
-    void basicOperations(AddressArgument op);                                       // 0***
     void clear();                                                                   // 00E0
     void ret();                                                                     // 00EE
     void jump(AddressArgument address);                                             // 1NNN
@@ -61,25 +285,26 @@ private:
     void skipRegisterEqual(RegisterIndex x, RegisterIndex y);                       // 5XY0
     void movValue(RegisterIndex x, RegisterArgument n);                             // 6XNN
     void addValue(RegisterIndex x, RegisterArgument n);                             // 7XNN
-    void registerOperations(RegisterIndex x, RegisterIndex y, RegisterArgument op); // 8XY*
     void registerMov(RegisterIndex x, RegisterIndex y);                             // 8XY0
     void registerOr(RegisterIndex x, RegisterIndex y);                              // 8XY1
     void registerAnd(RegisterIndex x, RegisterIndex y);                             // 8XY2
     void registerXor(RegisterIndex x, RegisterIndex y);                             // 8XY3
     void registerAdd(RegisterIndex x, RegisterIndex y);                             // 8XY4
     void registerSub(RegisterIndex x, RegisterIndex y);                             // 8XY5
+    template<class Quirks>
     void registerShiftRight(RegisterIndex x, RegisterIndex y);                      // 8XY6
     void registerMinus(RegisterIndex x, RegisterIndex y);                           // 8XY7
+    template<class Quirks>
     void registerShiftLeft(RegisterIndex x, RegisterIndex y);                       // 8XYE
     void skipRegisterNotEqual(RegisterIndex x, RegisterIndex y);                    // 9XY0
     void movAddress(AddressArgument address);                                       // ANNN
+    template<class Quirks>
     void jumpAddress(AddressArgument address);                                      // BNNN
     void rand(RegisterIndex x, RegisterArgument n);                                 // CXNN
+    template<class Quirks>
     void draw(RegisterIndex x, RegisterIndex y, RegisterArgument n);                // DXYN
-    void skipByKey(RegisterIndex x, RegisterArgument op);                           // EX**
     void skipPressed(RegisterIndex x);                                              // EX9E
     void skipNotPressed(RegisterIndex x);                                           // EXA1
-    void specialOperations(RegisterIndex x, RegisterArgument op);                   // FX**
     void getDelayTimer(RegisterIndex x);                                            // FX07
     void waitForKey(RegisterIndex x);                                               // FX0A
     void setDelayTimer(RegisterIndex x);                                            // FX15
@@ -87,36 +312,129 @@ private:
     void addIndex(RegisterIndex x);                                                 // FX1E
     void getSpriteAddress(RegisterIndex x);                                         // FX29
     void storeDecimal(RegisterIndex x);                                             // FX33
+    template<class Quirks>
     void storeRegisters(RegisterIndex x);                                           // FX55
+    template<class Quirks>
     void fillRegisters(RegisterIndex x);                                            // FX65
 private:
-    /* Registers */
-    GeneralRegister* V;
-    SpecialRegister I;
-    SpecialRegister PC;
+    /* Guest state */
+    MachineState state;
 
-    /* Memory */
-    unsigned char* mem;
-    unsigned char* gfx;
+    /* Pixels changed since the last presented frame */
+    FrameRow dirty[DISPLAY_LINES];
 
-    /* Timers */
-    Timer delayTimer;
-    Timer soundTimer;
+    /* Interpreter variant for the selected quirk profile */
+    QuirkProfile quirks;
+    Decoder decoder;
 
-    /* Stack */
-    unsigned short* stack;
-    SpecialRegister SP;
+    /* Allocated on first use so idle machines stay small */
+    CodeCache* code;
 
-    /* Keypad */
-    unsigned char* key;
+    /* Fast-forward busy-wait loops to the end of the slice, and over later
+       slices while the parked loop reads the same timer and keys */
+    bool idleSkipping;
+    IdleLoop idle;
 
-    /* Random number generator */
-    std::mt19937 randomGenerator;
-    std::uniform_int_distribution<RegisterArgument> dist;
+    /* Cycles counted without running, by idle skips and key waits, since construction */
+    unsigned long long skippedCycles;
 
-    /* Input and output */
-    bool frameReady;
+    /* Native code for hot blocks, only present outside interpreter mode */
+    ExecutionMode mode;
+    X86Recompiler* recompiler;
+
+    /* Blocks chip8aot compiled for the loaded program, in every mode */
+    PrecompiledCode* precompiled;
+
+    /* Input and output, owned by the caller */
     IO* io;
+
+    /* Counts executed instructions when set, owned by the caller */
+    Profiler* profiler;
+
+    /* Logs inputs, frames and optionally every step when set, owned by the caller */
+    Recorder* recorder;
+
+    /* Records control flow edges when set, owned by the caller */
+    Coverage* coverage;
+
+    /* Stops runs at breakpoints and watchpoints when set, owned by the
+       caller and bound to this machine, copies start without one */
+    Debugger* debugger;
+
+    /* 64-byte pages of mem written since the last reset, load or restore, one bit each */
+    unsigned long long dirtyPages;
+
+    /* GuestFault bits raised since the last reset or restore, and where the first one was */
+    unsigned char guestFaults;
+    SpecialRegister firstFault;
 };
 
+// One instruction at a time so the predicate sees every step, it is
+// checked after each one and gets the machine as the step left it
+template<class Predicate>
+StopReason CHIP8Emulator::runUntil(Predicate breakpoint, unsigned long cycles)
+{
+    unsigned long long end = state.cycles + cycles;
+
+    while(state.cycles < end)
+    {
+        runTick();
+
+        if(state.waitingForKey)
+        {
+            skipTo(end);
+            return StopReason::WaitingForKey;
+        }
+        if(breakpoint((const MachineState&)state))
+            return StopReason::Breakpoint;
+    }
+
+    return StopReason::BudgetExhausted;
+}
+
+/*
+ * The frame boundary bound to the backend's own type, which must be the
+ * IO the emulator was constructed with. With a final backend the calls are direct and can
+ * be inlined, the untemplated versions dispatch through IO for backends
+ * picked at runtime. Recording and profiling take the untemplated path.
+ */
+template<class Backend>
+void CHIP8Emulator::updateTimers(Backend& io)
+{
+    assert(static_cast<IO*>(&io) == this->io);
+
+    io.beep(state.soundTimer > 0);
+
+    updateDelayTimer();
+    updateSoundTimer();
+}
+
+template<class Backend>
+void CHIP8Emulator::drawFrame(Backend& io)
+{
+    assert(static_cast<IO*>(&io) == this->io);
+
+    if(recorder || profiler)
+        return drawFrame();
+
+    state.frameReady = false;
+    io.draw(state.gfx, dirty);
+    std::memset(dirty, 0, sizeof(dirty));
+}
+
+template<class Backend>
+void CHIP8Emulator::updateKeys(Backend& io)
+{
+    assert(static_cast<IO*>(&io) == this->io);
+
+    if(recorder)
+        return updateKeys();
+
+    io.updateKeys(state.cycles);
+    unsigned short keys = io.keyMask();
+
+    state.keyPresses = keys & ~state.keys;
+    state.keys = keys;
+}
+
 #endif      // _EMULATOR_H
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "captureio.h"
+#include "emulator.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Binary PBM, the leftmost pixel of each byte in its top bit
+static void writePBM(const std::string& file, const FrameRow* rows)
+{
+    std::ofstream out(file, std::ios::binary);
+    if(!out)
+        throw std::runtime_error("Could not open " + file);
+
+    out << "P4\n" << DISPLAY_COLUMNS << " " << DISPLAY_LINES << "\n";
+    for(int y = 0; y < DISPLAY_LINES; y++)
+        for(int x = 0; x < DISPLAY_COLUMNS; x += 8)
+        {
+            unsigned char pixels = 0;
+
+            for(int bit = 0; bit < 8; bit++)
+                if((rows[y] >> (x + bit)) & 1)
+                    pixels |= 0x80 >> bit;
+
+            out.put(pixels);
+        }
+}
+
+int main(int argc, char **argv)
+{
+    const char* pbmDirectory = nullptr;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--pbm" && argument + 1 < argc)
+            pbmDirectory = argv[++argument];
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument >= argc)
+    {
+        std::cerr << "Usage: chip8frames [--pbm DIRECTORY] capture.c8v" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ifstream file(argv[argument], std::ios::binary);
+        if(!file)
+            throw std::runtime_error(std::string("Could not open ") + argv[argument]);
+
+        CaptureReader capture(file);
+        FrameRow rows[DISPLAY_LINES];
+        unsigned long long frame = 0;
+
+        // One line per frame, hashed like the recorder and the batch runner do
+        for(; capture.next(rows); frame++)
+        {
+            char line[40];
+            std::snprintf(line, sizeof(line), "%llu %016llx\n", frame, CHIP8Emulator::hashFrame(rows));
+            std::cout << line;
+
+            if(pbmDirectory)
+            {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/frame%06llu.pbm", frame);
+                writePBM(pbmDirectory + std::string(name), rows);
+            }
+        }
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
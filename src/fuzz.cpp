@@ -0,0 +1,128 @@
+#include "fuzzer.h"
+#include "json.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#define DEFAULT_FRAMES 600
+#define DEFAULT_ROM_AFTER 100000
+#define DEFAULT_TIMEOUT 1.0
+#define CHUNK 1024                      // Executions between progress checks
+#define PROGRESS_INTERVAL 5.0
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    FuzzOptions options = { DEFAULT_FRAMES, ExecutionMode::Interpreter, QuirkProfile::Default, DEFAULT_ROM_AFTER, DEFAULT_TIMEOUT, 0 };
+    unsigned long long runs = 0;
+    double seconds = 0;
+    std::string output;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--frames" && argument + 1 < argc)
+            options.frames = std::strtoull(argv[++argument], nullptr, 10);
+        else if(option == "--runs" && argument + 1 < argc)
+            runs = std::strtoull(argv[++argument], nullptr, 10);
+        else if(option == "--seconds" && argument + 1 < argc)
+            seconds = std::strtod(argv[++argument], nullptr);
+        else if(option == "--seed" && argument + 1 < argc)
+            options.seed = std::strtoull(argv[++argument], nullptr, 0);
+        else if(option == "--quirks" && argument + 1 < argc && parseQuirkProfile(argv[argument + 1], options.quirks))
+            argument++;
+        else if(option == "--jit")
+            options.mode = ExecutionMode::Recompiler;
+        else if(option == "--rom-after" && argument + 1 < argc)
+            options.romAfter = std::strtoull(argv[++argument], nullptr, 10);
+        else if(option == "--timeout" && argument + 1 < argc)
+            options.timeout = std::strtod(argv[++argument], nullptr);
+        else if(option == "--out" && argument + 1 < argc)
+            output = argv[++argument];
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument + 1 != argc || !options.frames)
+    {
+        std::cerr << "Usage: chip8fuzz [--frames N] [--runs N] [--seconds N] [--seed N] [--quirks NAME] [--jit] "
+                     "[--rom-after N] [--timeout SECONDS] [--out DIRECTORY] program.ch8" << std::endl;
+        return 1;
+    }
+
+    // A minute unless told how long to run
+    if(!runs && !seconds)
+        seconds = 60;
+
+    try
+    {
+        std::string rom = argv[argument];
+        Clock::time_point start = Clock::now();
+        double progress = PROGRESS_INTERVAL;
+        Fuzzer fuzzer(rom, options);
+
+        while((!runs || fuzzer.executions() < runs) && (!seconds || secondsSince(start) < seconds))
+        {
+            fuzzer.run(runs ? std::min<unsigned long long>(CHUNK, runs - fuzzer.executions()) : CHUNK);
+
+            if(secondsSince(start) >= progress)
+            {
+                std::cerr << fuzzer.executions() << " executions, " << fuzzer.corpusSize() << " inputs, "
+                          << fuzzer.edgesCovered() << " edges, " << fuzzer.findings().size() << " findings" << std::endl;
+                progress += PROGRESS_INTERVAL;
+            }
+        }
+
+        double elapsed = secondsSince(start);
+        char address[8];
+
+        std::cout << "{\"rom\": " << jsonString(rom) << ", \"executions\": " << fuzzer.executions()
+                  << ", \"seconds\": " << elapsed
+                  << ", \"executions_per_second\": " << (unsigned long long)(fuzzer.executions() / elapsed)
+                  << ", \"corpus\": " << fuzzer.corpusSize()
+                  << ", \"edges\": " << fuzzer.edgesCovered() << ", \"findings\": [";
+
+        for(std::size_t i = 0; i < fuzzer.findings().size(); i++)
+        {
+            const FuzzFinding& finding = fuzzer.findings()[i];
+            std::string kind = Fuzzer::faultName(finding.faults);
+            std::snprintf(address, sizeof(address), "0x%03x", finding.address);
+
+            std::cout << (i ? ", " : "") << "{\"kind\": \"" << kind << "\", \"address\": \"" << address
+                      << "\", \"execution\": " << finding.execution;
+
+            if(!output.empty())
+            {
+                std::string path = output + "/" + kind + "-" + (address + 2);
+                fuzzer.writeFinding(finding, path);
+                std::cout << ", \"files\": " << jsonString(path);
+            }
+
+            std::cout << "}";
+        }
+
+        std::cout << "]}" << std::endl;
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
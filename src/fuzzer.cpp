@@ -0,0 +1,297 @@
+#include "fuzzer.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#define PROGRAM_LOCATION 0x200
+#define MAX_EVENTS 256
+#define MAX_PATCHES 64
+#define MAX_HOLD_FRAMES 30
+#define MAX_MUTATIONS 4
+#define TIMEOUT_CHECK 64        // Frames between looks at the clock, a backstop for hangs stuck() misses
+
+typedef std::chrono::steady_clock Clock;
+
+// AFL's hit count classes, a loop running a few more times is not new
+static unsigned char bucket(unsigned char hits)
+{
+    if(hits <= 3)
+        return 1 << (hits - 1);
+    if(hits < 8)
+        return 8;
+    if(hits < 16)
+        return 16;
+    if(hits < 32)
+        return 32;
+    if(hits < 128)
+        return 64;
+
+    return 128;
+}
+
+// Whether the guest can never move again: a jump to itself, or a key wait
+// with no key press coming. Runs are a few thousand instructions, they
+// end long before any clock could tell
+static bool stuck(const MachineState& state, bool inputLeft)
+{
+    if(state.waitingForKey && !state.keyPresses && !inputLeft)
+        return true;
+
+    return state.PC + 1 < MEMORY_SIZE && state.mem[state.PC] == (0x10 | state.PC >> 8) && state.mem[state.PC + 1] == (state.PC & 0xff);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+Fuzzer::Fuzzer(const std::string& rom, const FuzzOptions& options)
+    : options(options), cycleBudget(options.frames * DEFAULT_INSTRUCTIONS_PER_SECOND / TIMER_FREQUENCY), emulator(io),
+      seen{}, edges(0), random(options.seed), count(0)
+{
+    std::ifstream file(rom, std::ios::binary);
+    if(!file)
+        throw std::runtime_error("Could not open " + rom);
+
+    program.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if(program.size() > MEMORY_SIZE - PROGRAM_LOCATION)
+        program.resize(MEMORY_SIZE - PROGRAM_LOCATION);
+
+    // The same setup as a batch job, restored before every execution
+    emulator.setExecutionMode(options.mode);
+    emulator.setQuirkProfile(options.quirks);
+    emulator.reset();
+    emulator.load(rom);
+    emulator.setCoverage(&coverage);
+    snapshot = emulator.machineState();
+
+    // Whatever the program does without input is the first corpus entry
+    corpus.push_back(FuzzCase{ 0, {}, {} });
+    execute(corpus.front());
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void Fuzzer::run(unsigned long long executions)
+{
+    for(unsigned long long i = 0; i < executions; i++)
+    {
+        FuzzCase input = mutate(corpus[random() % corpus.size()]);
+
+        if(execute(input))
+            corpus.push_back(std::move(input));
+    }
+}
+
+// The patched program and a batch script, with the command that replays them
+void Fuzzer::writeFinding(const FuzzFinding& finding, const std::string& path) const
+{
+    std::vector<unsigned char> patched = program;
+    for(const RomPatch& patch : finding.input.patches)
+        patched[patch.address - PROGRAM_LOCATION] = patch.value;
+
+    std::ofstream rom(path + ".ch8", std::ios::binary);
+    std::ofstream script(path + ".txt");
+    if(!rom || !script)
+        throw std::runtime_error("Could not write " + path);
+
+    rom.write((const char *)patched.data(), patched.size());
+
+    char line[64];
+    std::snprintf(line, sizeof(line), "0x%03x", finding.address);
+    script << "# " << faultName(finding.faults) << " at " << line << ", execution " << finding.execution << "\n"
+           << "# chip8batch --frames " << options.frames << " --seed " << finding.input.seed
+           << " --quirks " << quirkProfileName(options.quirks) << (options.mode != ExecutionMode::Interpreter ? " --jit" : "")
+           << " --script " << path << ".txt " << path << ".ch8\n";
+
+    for(const InputEvent& event : finding.input.events)
+    {
+        std::snprintf(line, sizeof(line), "%llu %x %d\n", event.cycle, event.key, event.pressed);
+        script << line;
+    }
+}
+
+unsigned long long Fuzzer::executions() const
+{
+    return count;
+}
+
+std::size_t Fuzzer::corpusSize() const
+{
+    return corpus.size();
+}
+
+std::size_t Fuzzer::edgesCovered() const
+{
+    return edges;
+}
+
+const std::vector<FuzzFinding>& Fuzzer::findings() const
+{
+    return found;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+std::string Fuzzer::faultName(unsigned char faults)
+{
+    std::string name;
+
+    if(faults & FAULT_STACK_OVERFLOW)
+        name += "+stack_overflow";
+    if(faults & FAULT_STACK_UNDERFLOW)
+        name += "+stack_underflow";
+    if(faults & FAULT_MEMORY)
+        name += "+memory";
+
+    return name.empty() ? "hang" : name.substr(1);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// Runs like BatchRunner::runJob, so chip8batch reproduces every finding
+bool Fuzzer::execute(const FuzzCase& input)
+{
+    emulator.restoreDirtyPages(snapshot);
+    emulator.seed(input.seed);
+    for(const RomPatch& patch : input.patches)
+        emulator.writeMemory(patch.address, &patch.value, 1);
+
+    for(unsigned char key = 0; key < NUM_KEYS; key++)
+        io.setKey(key, false);
+    coverage.clear();
+    count++;
+
+    Scheduler scheduler(emulator);
+    std::size_t nextEvent = 0;
+    Clock::time_point start = Clock::now();
+
+    while(scheduler.frameCount() < options.frames)
+    {
+        for(; nextEvent < input.events.size() && input.events[nextEvent].cycle <= emulator.cycleCount(); nextEvent++)
+            io.setKey(input.events[nextEvent].key, input.events[nextEvent].pressed);
+
+        scheduler.runFrame(io);
+
+        if(stuck(emulator.machineState(), nextEvent < input.events.size()) ||
+           (scheduler.frameCount() % TIMEOUT_CHECK == 0 &&
+            std::chrono::duration<double>(Clock::now() - start).count() > options.timeout))
+        {
+            report(0, emulator.machineState().PC, input);
+            return false;
+        }
+    }
+
+    // Like AFL, inputs that crash are findings and not worth building on
+    if(emulator.faults())
+    {
+        report(emulator.faults(), emulator.faultAddress(), input);
+        return false;
+    }
+
+    return newCoverage();
+}
+
+bool Fuzzer::newCoverage()
+{
+    const unsigned char* hits = coverage.map();
+    bool novel = false;
+
+    // Most of the map is untouched, skip it a word at a time
+    for(std::size_t word = 0; word < COVERAGE_MAP_SIZE; word += sizeof(unsigned long long))
+    {
+        unsigned long long any;
+        std::memcpy(&any, hits + word, sizeof(any));
+        if(!any)
+            continue;
+
+        for(std::size_t edge = word; edge < word + sizeof(any); edge++)
+        {
+            if(!hits[edge])
+                continue;
+
+            unsigned char bit = bucket(hits[edge]);
+            if(seen[edge] & bit)
+                continue;
+
+            edges += !seen[edge];
+            seen[edge] |= bit;
+            novel = true;
+        }
+    }
+
+    return novel;
+}
+
+// Seeds and key presses first, program bytes once those found what they can
+FuzzCase Fuzzer::mutate(const FuzzCase& parent)
+{
+    FuzzCase child = parent;
+    bool patching = count >= options.romAfter && !program.empty();
+    unsigned int mutations = 1 + random() % MAX_MUTATIONS;
+
+    for(unsigned int i = 0; i < mutations; i++)
+    {
+        switch(random() % (patching ? 6 : 4))
+        {
+        case 0:
+            child.seed = random();
+            break;
+        case 1:
+            // A press and its release, FX0A only sees keys going down
+            if(child.events.size() + 2 <= MAX_EVENTS)
+            {
+                InputEvent press = { random() % cycleBudget, (unsigned char)(random() % NUM_KEYS), true };
+                InputEvent release = { press.cycle + 1 + random() % (cycleBudget / options.frames * MAX_HOLD_FRAMES + 1), press.key, false };
+
+                child.events.push_back(press);
+                child.events.push_back(release);
+            }
+            break;
+        case 2:
+            if(!child.events.empty())
+                child.events.erase(child.events.begin() + random() % child.events.size());
+            break;
+        case 3:
+            if(!child.events.empty())
+                child.events[random() % child.events.size()].cycle = random() % cycleBudget;
+            break;
+        case 4:
+        {
+            SpecialRegister address = PROGRAM_LOCATION + random() % program.size();
+            auto patch = std::find_if(child.patches.begin(), child.patches.end(),
+                                      [address](const RomPatch& patch) { return patch.address == address; });
+            unsigned char value = patch != child.patches.end() ? patch->value : program[address - PROGRAM_LOCATION];
+
+            // Single bit flips first and foremost, they keep most instructions decodable
+            value = random() % 4 ? value ^ (1 << random() % 8) : random();
+
+            if(patch != child.patches.end())
+                patch->value = value;
+            else if(child.patches.size() < MAX_PATCHES)
+                child.patches.push_back({ address, value });
+            break;
+        }
+        case 5:
+            if(!child.patches.empty())
+                child.patches.erase(child.patches.begin() + random() % child.patches.size());
+            break;
+        }
+    }
+
+    std::stable_sort(child.events.begin(), child.events.end(),
+                     [](const InputEvent& a, const InputEvent& b) { return a.cycle < b.cycle; });
+
+    return child;
+}
+
+void Fuzzer::report(unsigned char faults, SpecialRegister address, const FuzzCase& input)
+{
+    // Once per kind and place, the first input that got there is enough
+    if(!reported.insert({ faults, address }).second)
+        return;
+
+    found.push_back({ faults, address, count, input });
+}
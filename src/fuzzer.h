@@ -0,0 +1,96 @@
+#ifndef _FUZZER_H
+#define _FUZZER_H
+
+#include "batchrunner.h"
+#include "coverage.h"
+#include "emulator.h"
+#include "headlessio.h"
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct RomPatch
+{
+    SpecialRegister address;
+    unsigned char value;
+};
+
+/* One execution's input, the same a batch job takes plus changed ROM bytes */
+struct FuzzCase
+{
+    unsigned long long seed;
+    std::vector<InputEvent> events;     // Sorted by cycle
+    std::vector<RomPatch> patches;
+};
+
+struct FuzzOptions
+{
+    unsigned long long frames;          // 60 Hz guest frames per execution
+    ExecutionMode mode;
+    QuirkProfile quirks;
+    unsigned long long romAfter;        // Executions before ROM bytes are mutated too
+    double timeout;                     // Seconds before an execution counts as hung
+    unsigned long long seed;            // For the mutator, runs are reproducible
+};
+
+struct FuzzFinding
+{
+    unsigned char faults;               // GuestFault bits, 0 for a hang
+    SpecialRegister address;            // First faulting instruction, or PC when it hung
+    unsigned long long execution;
+    FuzzCase input;
+};
+
+/*
+ * Coverage guided fuzzing of one program. Every execution starts from the
+ * state right after loading, which restoreDirtyPages() brings back by only
+ * copying the memory pages the previous execution wrote. Inputs that reach
+ * new control flow edges join the corpus, guest faults and hangs are kept
+ * once per kind and address.
+ */
+class Fuzzer
+{
+public:
+    /* Constructors */
+    Fuzzer(const std::string& rom, const FuzzOptions& options);
+
+    /* Instance methods */
+    void run(unsigned long long executions);
+    void writeFinding(const FuzzFinding& finding, const std::string& path) const;
+    unsigned long long executions() const;
+    std::size_t corpusSize() const;
+    std::size_t edgesCovered() const;
+    const std::vector<FuzzFinding>& findings() const;
+
+    /* Static methods */
+    static std::string faultName(unsigned char faults);
+private:
+    /* Auxiliary methods */
+    bool execute(const FuzzCase& input);
+    bool newCoverage();
+    FuzzCase mutate(const FuzzCase& parent);
+    void report(unsigned char faults, SpecialRegister address, const FuzzCase& input);
+private:
+    FuzzOptions options;
+    std::vector<unsigned char> program;
+    unsigned long long cycleBudget;
+
+    HeadlessIO io;
+    CHIP8Emulator emulator;
+    MachineState snapshot;
+    Coverage coverage;
+
+    /* Hit count buckets seen so far per edge, one bit each */
+    unsigned char seen[COVERAGE_MAP_SIZE];
+    std::size_t edges;
+
+    std::vector<FuzzCase> corpus;
+    std::vector<FuzzFinding> found;
+    std::set<std::pair<unsigned char, SpecialRegister>> reported;
+    std::mt19937_64 random;
+    unsigned long long count;
+};
+
+#endif  // _FUZZER_H
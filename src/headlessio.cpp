@@ -0,0 +1,66 @@
+#include "headlessio.h"
+#include <cstring>
+
+HeadlessIOBase::HeadlessIOBase()
+    : keys(0), frame{}, frames(0)
+{
+
+}
+
+void HeadlessIOBase::draw(const unsigned char* gfx)
+{
+    for(int y = 0; y < DISPLAY_LINES; y++)
+    {
+        frame[y] = 0;
+
+        for(int x = 0; x < DISPLAY_COLUMNS; x++)
+            if(gfx[x + (y * DISPLAY_COLUMNS)])
+                frame[y] |= (FrameRow)1 << x;
+    }
+
+    frames++;
+}
+
+void HeadlessIOBase::draw(const FrameRow* rows)
+{
+    std::memcpy(frame, rows, sizeof(frame));
+    frames++;
+}
+
+void HeadlessIOBase::draw(const FrameRow* rows, const FrameRow* dirty)
+{
+    draw(rows);
+}
+
+void HeadlessIOBase::updateKeys()
+{
+
+}
+
+bool HeadlessIOBase::isKeyPressed(unsigned char keyValue)
+{
+    return keys & (1 << (keyValue % NUM_KEYS));
+}
+
+unsigned short HeadlessIOBase::keyMask()
+{
+    return keys;
+}
+
+void HeadlessIOBase::setKey(unsigned char keyValue, bool pressed)
+{
+    if(pressed)
+        keys |= 1 << (keyValue % NUM_KEYS);
+    else
+        keys &= ~(1 << (keyValue % NUM_KEYS));
+}
+
+unsigned long long HeadlessIOBase::framesDrawn() const
+{
+    return frames;
+}
+
+const FrameRow* HeadlessIOBase::lastFrame() const
+{
+    return frame;
+}
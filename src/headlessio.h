@@ -0,0 +1,38 @@
+#ifndef _HEADLESSIO_H
+#define _HEADLESSIO_H
+
+#include "io.h"
+
+/*
+ * Keeps the last frame and the keys set by the caller, nothing is shown.
+ * Backends that add to it, like captures and replays, derive from
+ * HeadlessIOBase; HeadlessIO is the final plain one, so the templated
+ * frame boundary calls it directly.
+ */
+class HeadlessIOBase : public IO
+{
+public:
+    HeadlessIOBase();
+
+    virtual void draw(const unsigned char* gfx) override;
+    virtual void draw(const FrameRow* rows) override;
+    virtual void draw(const FrameRow* rows, const FrameRow* dirty) override;
+    using IO::updateKeys;
+    virtual void updateKeys() override final;
+    virtual bool isKeyPressed(unsigned char keyValue) override final;
+    virtual unsigned short keyMask() override final;
+
+    void setKey(unsigned char keyValue, bool pressed);
+    unsigned long long framesDrawn() const;
+    const FrameRow* lastFrame() const;
+private:
+    unsigned short keys;
+    FrameRow frame[DISPLAY_LINES];
+    unsigned long long frames;
+};
+
+class HeadlessIO final : public HeadlessIOBase
+{
+};
+
+#endif  // _HEADLESSIO_H
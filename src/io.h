@@ -1,15 +1,75 @@
 #ifndef _IO_H
 #define _IO_H
 
+#include <cstdint>
+
+#define DISPLAY_LINES 32
+#define DISPLAY_COLUMNS 64
+#define NUM_KEYS 16
+
+/* One display line, bit x holds the pixel in column x */
+typedef uint64_t FrameRow;
+
 class IO
 {
 public:
+    virtual ~IO() {}
+
     /* Video */
     virtual void draw(const unsigned char *gfx) = 0;
+    virtual void draw(const FrameRow *rows);
+    virtual void draw(const FrameRow *rows, const FrameRow *dirty);
 
     /* Input */
     virtual void updateKeys() = 0;
+    virtual void updateKeys(unsigned long long cycle);
     virtual bool isKeyPressed(unsigned char keyValue) = 0;
+    virtual unsigned short keyMask();
+
+    /* Sound, once per 60 Hz frame with whether the tone played during it */
+    virtual void beep(bool on);
 };
 
-#endif  // _IO_H
\ No newline at end of file
+// Backends without a packed path get the display expanded to a byte per pixel
+inline void IO::draw(const FrameRow *rows)
+{
+    unsigned char gfx[DISPLAY_LINES * DISPLAY_COLUMNS];
+
+    for(int y = 0; y < DISPLAY_LINES; y++)
+        for(int x = 0; x < DISPLAY_COLUMNS; x++)
+            gfx[x + (y * DISPLAY_COLUMNS)] = (rows[y] >> x) & 1;
+
+    draw(gfx);
+}
+
+// Backends that always repaint everything ignore the dirty pixels
+inline void IO::draw(const FrameRow *rows, const FrameRow *dirty)
+{
+    draw(rows);
+}
+
+// Only backends that replay input care about the guest clock
+inline void IO::updateKeys(unsigned long long cycle)
+{
+    updateKeys();
+}
+
+// All sixteen keys at once, bit k set while key k is down
+inline unsigned short IO::keyMask()
+{
+    unsigned short keys = 0;
+
+    for(unsigned char key = 0; key < NUM_KEYS; key++)
+        if(isKeyPressed(key))
+            keys |= 1 << key;
+
+    return keys;
+}
+
+// Backends without sound stay silent
+inline void IO::beep(bool on)
+{
+
+}
+
+#endif  // _IO_H
@@ -0,0 +1,33 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <cstdio>
+#include <string>
+
+// A JSON string literal, quotes included, for paths and messages the
+// tools print. Control characters become \u escapes
+inline std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+
+    for(unsigned char c : text)
+    {
+        if(c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if(c < 0x20)
+        {
+            char escape[7];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        }
+        else
+            quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+#endif  // _JSON_H
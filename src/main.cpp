@@ -1,12 +1,235 @@
+#include "ansiterminalio.h"
+#include "asyncio.h"
+#include "audio.h"
 #include "emulator.h"
+#include "ncursesio.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "scheduler.h"
+#include "sharedmemoryio.h"
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
-int main(int argc, char **argv)
+static Scheduler* running = nullptr;
+
+// Leave the main loop so the terminal is restored and reports get written
+static void stopRunning(int)
+{
+    if(running)
+        running->stop();
+}
+
+// kill -USR1 writes a save state, kill -USR2 steps back one second
+static void saveOrRewind(int signal)
 {
-    if(argc > 1)
-        CHIP8Emulator::run(argv[1]);
+    if(!running)
+        return;
+
+    if(signal == SIGUSR1)
+        running->requestSave();
     else
+        running->requestRewind(TIMER_FREQUENCY);
+}
+
+int main(int argc, char **argv)
+{
+    ExecutionMode mode = ExecutionMode::Interpreter;
+    QuirkProfile quirks = QuirkProfile::Default;
+    unsigned int instructionsPerSecond = DEFAULT_INSTRUCTIONS_PER_SECOND;
+    const char* stateFile = nullptr;
+    const char* saveFile = nullptr;
+    const char* profileFile = nullptr;
+    const char* recordFile = nullptr;
+    const char* wavFile = nullptr;
+    const char* shareName = nullptr;
+    bool trace = false;
+    bool ansi = false;
+    bool rewind = false;
+    bool quirksGiven = false;
+    bool seeded = false;
+    unsigned long long seed = 0;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--jit")
+            mode = ExecutionMode::Recompiler;
+        else if(option == "--jit-diff")
+            mode = ExecutionMode::Differential;
+        else if(option == "--ips" && argument + 1 < argc && std::strtoul(argv[argument + 1], nullptr, 10) > 0)
+            instructionsPerSecond = std::strtoul(argv[++argument], nullptr, 10);
+        else if(option == "--state" && argument + 1 < argc)
+            stateFile = argv[++argument];
+        else if(option == "--save" && argument + 1 < argc)
+            saveFile = argv[++argument];
+        else if(option == "--rewind")
+            rewind = true;
+        else if(option == "--profile" && argument + 1 < argc)
+            profileFile = argv[++argument];
+        else if(option == "--seed" && argument + 1 < argc)
+        {
+            seed = std::strtoull(argv[++argument], nullptr, 0);
+            seeded = true;
+        }
+        else if(option == "--record" && argument + 1 < argc)
+            recordFile = argv[++argument];
+        else if(option == "--trace")
+            trace = true;
+        else if(option == "--wav" && argument + 1 < argc)
+            wavFile = argv[++argument];
+        else if(option == "--ansi")
+            ansi = true;
+        else if(option == "--share" && argument + 1 < argc)
+            shareName = argv[++argument];
+        else if(option == "--quirks" && argument + 1 < argc && parseQuirkProfile(argv[argument + 1], quirks))
+        {
+            quirksGiven = true;
+            argument++;
+        }
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument >= argc)
+    {
         std::cerr << "Pass the name of the program file as argument" << std::endl;
+        return 0;
+    }
+
+    // A replay could not follow the machine back in time
+    if(rewind && recordFile)
+    {
+        std::cerr << "--rewind cannot be used with --record" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        Profiler profiler;
+        RewindBuffer history;
+        MachineState last;
+        unsigned int failedSaves = 0;
+        std::ofstream recording;
+        std::unique_ptr<Recorder> recorder;
+
+        // The terminal is restored when io goes out of scope, after the
+        // renderer has presented the last frame
+        {
+            std::unique_ptr<IO> terminal;
+            if(ansi)
+                terminal.reset(new AnsiTerminalIO());
+            else
+                terminal.reset(new NCursesIO());
+
+            AsyncIO video(*terminal);
+            IO* io = &video;
+
+            // The terminal cannot play sound, it can only be saved
+            std::unique_ptr<WavSink> wav;
+            std::unique_ptr<AudioIO> audio;
+            if(wavFile)
+            {
+                wav.reset(new WavSink(wavFile));
+                audio.reset(new AudioIO(video, *wav));
+                io = audio.get();
+            }
+
+            // Viewers in other processes see what the terminal shows
+            std::unique_ptr<SharedMemoryIO> shared;
+            if(shareName)
+            {
+                shared.reset(new SharedMemoryIO(*io, shareName));
+                io = shared.get();
+            }
+
+            CHIP8Emulator emulator(*io);
+            if(shared)
+                shared->watch(emulator.machineState());
+
+            emulator.setExecutionMode(mode);
+            emulator.setQuirkProfile(quirks);
+            emulator.reset();
+            if(seeded)
+                emulator.seed(seed);
+            emulator.load(argv[argument]);
+
+            // Resume a reported session on top of the loaded program
+            if(stateFile)
+            {
+                std::ifstream state(stateFile, std::ios::binary);
+                if(!state)
+                    throw std::runtime_error(std::string("Could not open ") + stateFile);
+                emulator.loadState(state);
+
+                if(quirksGiven && emulator.quirkProfile() != quirks)
+                    throw std::runtime_error(std::string("The save state was taken with --quirks ") + quirkProfileName(emulator.quirkProfile()));
+            }
+
+            if(profileFile)
+                emulator.setProfiler(&profiler);
+
+            // The log starts from the full machine, replays need no program file
+            if(recordFile)
+            {
+                recording.open(recordFile, std::ios::binary);
+                if(!recording)
+                    throw std::runtime_error(std::string("Could not open ") + recordFile);
+                recorder.reset(new Recorder(recording, trace));
+                recorder->begin(emulator.machineState(), instructionsPerSecond, emulator.quirkProfile());
+                emulator.setRecorder(recorder.get());
+            }
+
+            Scheduler scheduler(emulator, instructionsPerSecond);
+            if(rewind)
+                scheduler.setRewindBuffer(&history);
+            if(saveFile)
+                scheduler.setStateFile(saveFile);
+
+            running = &scheduler;
+            std::signal(SIGINT, stopRunning);
+            std::signal(SIGTERM, stopRunning);
+            std::signal(SIGUSR1, saveOrRewind);
+            std::signal(SIGUSR2, saveOrRewind);
+
+            scheduler.run();
+
+            running = nullptr;
+            last = emulator.machineState();
+            failedSaves = scheduler.failedSaves();
+
+            if(recorder)
+                recorder->finish();
+        }
+
+        if(profileFile)
+        {
+            std::ofstream report(profileFile);
+            profiler.writeJSON(report, last.mem);
+            profiler.writeHotSpots(std::cerr, last.mem);
+        }
+
+        // Only now that the terminal is back can the error be seen
+        if(failedSaves)
+        {
+            std::cerr << "Could not write " << saveFile << ", " << failedSaves << " save states were lost" << std::endl;
+            return 1;
+        }
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
 
     return 0;
-}
\ No newline at end of file
+}
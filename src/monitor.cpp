@@ -0,0 +1,92 @@
+#include "sharedmemoryio.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define POLL_INTERVAL std::chrono::milliseconds(1)
+
+static volatile std::sig_atomic_t stopping = 0;
+
+static void stopMonitoring(int)
+{
+    stopping = 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long limit = 0;
+    std::vector<unsigned char> keys;
+    std::string name = DEFAULT_SHARED_NAME;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--frames" && argument + 1 < argc)
+            limit = std::strtoull(argv[++argument], nullptr, 10);
+        else if(option == "--press" && argument + 1 < argc)
+            keys.push_back(std::strtoul(argv[++argument], nullptr, 16) & 0xf);
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument + 1 < argc)
+    {
+        std::cerr << "Usage: chip8monitor [--frames N] [--press KEY]... [NAME]" << std::endl;
+        return 1;
+    }
+    if(argument < argc)
+        name = argv[argument];
+
+    try
+    {
+        SharedMemoryView view(name);
+        SharedState state;
+        unsigned long long printed = 0, frame = ~0ULL;
+
+        std::signal(SIGINT, stopMonitoring);
+        std::signal(SIGTERM, stopMonitoring);
+
+        for(unsigned char key : keys)
+            view.setKey(key, true);
+
+        // One line per guest frame, frames the monitor was too slow for are skipped
+        while(!stopping && view.running() && (!limit || printed < limit))
+        {
+            if(!view.read(state) || state.frames == frame)
+            {
+                std::this_thread::sleep_for(POLL_INTERVAL);
+                continue;
+            }
+            frame = state.frames;
+
+            char line[160];
+            std::snprintf(line, sizeof(line), "{\"frame\": %llu, \"cycles\": %llu, \"pc\": \"0x%03x\", \"i\": \"0x%03x\", "
+                          "\"frames_drawn\": %llu, \"frame_hash\": \"%016llx\"}",
+                          (unsigned long long)state.frames, (unsigned long long)state.cycles, state.PC, state.I,
+                          (unsigned long long)state.framesPresented, CHIP8Emulator::hashFrame(state.rows));
+            std::cout << line << std::endl;
+            printed++;
+        }
+
+        for(unsigned char key : keys)
+            view.setKey(key, false);
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -7,6 +7,8 @@
 #define NUM_PIXELS (NUM_COLUMNS * NUM_LINES)
 #define BLACK_PAIR 1
 #define WHITE_PAIR 2
+#define BLANK_LINE "                                                                " \
+                   "                                                                "
 
 NCursesIO::NCursesIO()
 {
@@ -24,10 +26,12 @@ NCursesIO::NCursesIO()
     start_color();
     init_pair(BLACK_PAIR, COLOR_BLACK, COLOR_BLACK);
     init_pair(WHITE_PAIR, COLOR_WHITE, COLOR_WHITE);
+    keypad.start();
 }
 
 NCursesIO::~NCursesIO()
 {
+    keypad.stop();
     endwin();
 }
 
@@ -51,17 +55,66 @@ void NCursesIO::draw(const unsigned char* gfx)
     refresh();
 }
 
+void NCursesIO::draw(const FrameRow* rows)
+{
+    FrameRow dirty[NUM_LINES];
+
+    for(int y = 0; y < NUM_LINES; y++)
+        dirty[y] = ~(FrameRow)0;
+
+    draw(rows, dirty);
+}
+
+void NCursesIO::draw(const FrameRow* rows, const FrameRow* dirty)
+{
+    static const char blank[] = BLANK_LINE;
+    int pair;
+
+    for(int y = 0; y < NUM_LINES; y++)
+    {
+        FrameRow changed = dirty[y];
+        FrameRow row = rows[y];
+
+        while(changed)
+        {
+            // Extend the run while pixels are dirty and keep the same colour
+            int start = __builtin_ctzll(changed);
+            int end = start + 1;
+            bool lit = (row >> start) & 1;
+
+            while(end < NUM_COLUMNS && ((changed >> end) & 1) && (((row >> end) & 1) == lit))
+                end++;
+
+            // Draw
+            pair = (lit ? WHITE_PAIR : BLACK_PAIR);
+            attron(COLOR_PAIR(pair));
+            mvaddnstr(y, start*2, blank, (end - start)*2);
+            attroff(COLOR_PAIR(pair));
+
+            changed = (end < NUM_COLUMNS) ? changed & ~(((FrameRow)1 << end) - 1) : 0;
+        }
+    }
+
+    refresh();
+}
+
+// The keypad thread keeps the mask current
 void NCursesIO::updateKeys()
 {
-    
+
 }
 
 bool NCursesIO::isKeyPressed(unsigned char keyValue)
 {
-    return true;
+    return keyMask() & (1 << keyValue);
+}
+
+unsigned short NCursesIO::keyMask()
+{
+    return keypad.keyMask();
 }
 
 bool NCursesIO::anyKeyPressed()
 {
-    return true;
-}
\ No newline at end of file
+    return keyMask() != 0;
+}
@@ -2,22 +2,26 @@
 #define _NCURSESIO_H
 
 #include "io.h"
+#include "terminalkeypad.h"
 #include <ncurses.h>
 
-#define NUM_KEYS 16
-
-class NCursesIO : public IO
+/* Terminal display through ncurses, two spaces per pixel, and keypad */
+class NCursesIO final : public IO
 {
 public:
     NCursesIO();
     ~NCursesIO();
 
     virtual void draw(const unsigned char* gfx) override;
+    virtual void draw(const FrameRow* rows) override;
+    virtual void draw(const FrameRow* rows, const FrameRow* dirty) override;
+    using IO::updateKeys;
     virtual void updateKeys() override;
     virtual bool isKeyPressed(unsigned char keyValue) override;
+    virtual unsigned short keyMask() override;
     virtual bool anyKeyPressed();
 private:
-    bool keyList[NUM_KEYS];
+    TerminalKeypad keypad;
 };
 
 #endif  // _NCURSESIO_H
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "precompiled.h"
+#include <cstring>
+#include <vector>
+
+#define PROGRAM_LOCATION 0x200
+#define MAX_BLOCK_LENGTH 64
+
+// Built during static initialisation, so it has to exist before first use
+static std::vector<const PrecompiledProgram*>& registry()
+{
+    static std::vector<const PrecompiledProgram*> programs;
+
+    return programs;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+PrecompiledRegistration::PrecompiledRegistration(const PrecompiledProgram& program)
+{
+    registry().push_back(&program);
+}
+
+const PrecompiledProgram* findPrecompiled(const unsigned char* mem, QuirkProfile quirks)
+{
+    for(const PrecompiledProgram* program : registry())
+        if(program->quirks == quirks && program->size <= MEMORY_SIZE - PROGRAM_LOCATION &&
+           std::memcmp(mem + PROGRAM_LOCATION, program->rom, program->size) == 0)
+            return program;
+
+    return nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+PrecompiledCode::PrecompiledCode(const PrecompiledProgram& program)
+    : entries{}, lengths{}
+{
+    for(unsigned short i = 0; i < program.numBlocks; i++)
+    {
+        const PrecompiledBlock& block = program.blocks[i];
+
+        entries[block.address / 2] = block.body;
+        lengths[block.address / 2] = block.length;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// The emulator splits blocks the way chip8aot did, a different length
+// means the block was entered some other way and stays interpreted
+CompiledBlock PrecompiledCode::lookup(SpecialRegister address, unsigned char length) const
+{
+    unsigned int slot = address / 2;
+
+    return lengths[slot] == length ? entries[slot] : nullptr;
+}
+
+void PrecompiledCode::invalidate(SpecialRegister address, unsigned short length)
+{
+    if(length == 0 || address >= MEMORY_SIZE)
+        return;
+
+    unsigned int last = address + length - 1;
+    if(last >= MEMORY_SIZE)
+        last = MEMORY_SIZE - 1;
+
+    // Any block starting up to MAX_BLOCK_LENGTH slots earlier may cover the range
+    unsigned int firstBlock = (address / 2 >= MAX_BLOCK_LENGTH - 1) ? address / 2 - (MAX_BLOCK_LENGTH - 1) : 0;
+    for(unsigned int slot = firstBlock; slot <= last / 2; slot++)
+    {
+        entries[slot] = nullptr;
+        lengths[slot] = 0;
+    }
+}
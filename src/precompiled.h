@@ -0,0 +1,56 @@
+#ifndef _PRECOMPILED_H
+#define _PRECOMPILED_H
+
+#include "emulator.h"
+
+/*
+ * Programs translated to C++ ahead of time by chip8aot. Every block body
+ * becomes a CompiledBlock, the same contract recompiled blocks follow:
+ * the body runs natively, the terminator goes through the interpreter.
+ * A generated translation unit registers its program before main() runs,
+ * emulators pick it up whenever the same program is loaded under the same
+ * quirk profile.
+ */
+
+struct PrecompiledBlock
+{
+    SpecialRegister address;
+    unsigned char length;           // Instructions including the terminator
+    CompiledBlock body;
+};
+
+struct PrecompiledProgram
+{
+    const char* name;
+    const unsigned char* rom;       // The bytes the blocks were generated from
+    unsigned short size;
+    QuirkProfile quirks;
+    const PrecompiledBlock* blocks;
+    unsigned short numBlocks;
+};
+
+/* Generated code adds its program through a static instance */
+struct PrecompiledRegistration
+{
+    explicit PrecompiledRegistration(const PrecompiledProgram& program);
+};
+
+/* A registered program loaded unmodified at PROGRAM_LOCATION, or null */
+const PrecompiledProgram* findPrecompiled(const unsigned char* mem, QuirkProfile quirks);
+
+/* One emulator's view of a precompiled program, written code drops out */
+class PrecompiledCode
+{
+public:
+    /* Constructors */
+    explicit PrecompiledCode(const PrecompiledProgram& program);
+
+    /* Instance methods */
+    CompiledBlock lookup(SpecialRegister address, unsigned char length) const;
+    void invalidate(SpecialRegister address, unsigned short length);
+private:
+    CompiledBlock entries[MEMORY_SIZE / 2];
+    unsigned char lengths[MEMORY_SIZE / 2];
+};
+
+#endif  // _PRECOMPILED_H
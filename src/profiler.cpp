@@ -0,0 +1,211 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+
+static const char* familyNames[NUM_FAMILIES] = {
+    "0NNN", "00E0", "00EE", "1NNN", "2NNN", "3XNN",
+    "4XNN", "5XY0", "6XNN", "7XNN", "8XY0", "8XY1",
+    "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7",
+    "8XYE", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN",
+    "EX9E", "EXA1", "FX07", "FX0A", "FX15", "FX18",
+    "FX1E", "FX29", "FX33", "FX55", "FX65", "unknown"
+};
+
+/////////////////////////////////////////////////////////////////////////
+
+ScopedTimer::ScopedTimer(TimeCounter& counter)
+    : counter(counter), start(std::chrono::steady_clock::now())
+{
+
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    counter.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    counter.calls++;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+Profiler::Profiler()
+    : families(), addresses(), sprites(), presents()
+{
+
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void Profiler::countInstruction(SpecialRegister address, unsigned char family)
+{
+    families[family]++;
+    addresses[address % MEMORY_SIZE]++;
+}
+
+void Profiler::countBlock(SpecialRegister address, const DecodedInstruction* block, unsigned char length)
+{
+    // Blocks only branch at the end, every instruction in them runs once
+    for(unsigned char i = 0; i < length; i++)
+    {
+        families[block[i].family]++;
+        addresses[(address + i * 2) % MEMORY_SIZE]++;
+    }
+}
+
+TimeCounter& Profiler::spriteTime()
+{
+    return sprites;
+}
+
+TimeCounter& Profiler::presentTime()
+{
+    return presents;
+}
+
+unsigned long long Profiler::instructions() const
+{
+    unsigned long long total = 0;
+
+    for(int i = 0; i < NUM_FAMILIES; i++)
+        total += families[i];
+
+    return total;
+}
+
+void Profiler::writeJSON(std::ostream& out, const unsigned char* mem, std::size_t hotSpots) const
+{
+    SpecialRegister hot[MEMORY_SIZE];
+    std::size_t count = hottest(hot, hotSpots);
+
+    out << "{\n  \"instructions\": " << instructions() << ",\n  \"families\": {";
+
+    bool first = true;
+    for(int i = 0; i < NUM_FAMILIES; i++)
+    {
+        if(!families[i])
+            continue;
+        out << (first ? "" : ",") << "\n    \"" << familyNames[i] << "\": " << families[i];
+        first = false;
+    }
+
+    out << "\n  },\n  \"hot_pcs\": [";
+    for(std::size_t i = 0; i < count; i++)
+    {
+        unsigned short instruction = mem[hot[i]] << 8 | mem[(hot[i] + 1) % MEMORY_SIZE];
+
+        out << (i ? "," : "") << std::hex << std::setfill('0')
+            << "\n    {\"pc\": \"" << std::setw(3) << hot[i] << "\", \"opcode\": \"" << std::setw(4) << instruction << "\", "
+            << std::dec << "\"count\": " << addresses[hot[i]] << "}";
+    }
+
+    out << "\n  ],\n"
+        << "  \"sprite_draw\": {\"calls\": " << sprites.calls << ", \"nanoseconds\": " << sprites.nanoseconds << "},\n"
+        << "  \"io_draw\": {\"calls\": " << presents.calls << ", \"nanoseconds\": " << presents.nanoseconds << "}\n"
+        << "}" << std::endl;
+}
+
+void Profiler::writeHotSpots(std::ostream& out, const unsigned char* mem, std::size_t hotSpots) const
+{
+    SpecialRegister hot[MEMORY_SIZE];
+    std::size_t count = hottest(hot, hotSpots);
+    double total = instructions() ? instructions() : 1;
+
+    out << "     %      count  pc   opcode  family" << std::endl;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        unsigned short instruction = mem[hot[i]] << 8 | mem[(hot[i] + 1) % MEMORY_SIZE];
+
+        out << std::fixed << std::setprecision(2) << std::setfill(' ') << std::setw(6) << 100 * addresses[hot[i]] / total
+            << std::setw(11) << addresses[hot[i]] << "  "
+            << std::hex << std::setfill('0') << std::setw(3) << hot[i] << "  " << std::setw(4) << instruction << std::dec
+            << "    " << familyNames[familyOf(instruction)] << std::endl;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+unsigned char Profiler::familyOf(unsigned short instruction)
+{
+    unsigned char low = instruction & 0xff;
+
+    switch(instruction >> 12)
+    {
+    case 0x0:
+        if((instruction & 0xfff) == 0xe0)
+            return FAMILY_00E0;
+        if((instruction & 0xfff) == 0xee)
+            return FAMILY_00EE;
+        return FAMILY_0NNN;
+    case 0x1: return FAMILY_1NNN;
+    case 0x2: return FAMILY_2NNN;
+    case 0x3: return FAMILY_3XNN;
+    case 0x4: return FAMILY_4XNN;
+    case 0x5: return FAMILY_5XY0;
+    case 0x6: return FAMILY_6XNN;
+    case 0x7: return FAMILY_7XNN;
+    case 0x8:
+        switch(instruction & 0xf)
+        {
+        case 0x0: return FAMILY_8XY0;
+        case 0x1: return FAMILY_8XY1;
+        case 0x2: return FAMILY_8XY2;
+        case 0x3: return FAMILY_8XY3;
+        case 0x4: return FAMILY_8XY4;
+        case 0x5: return FAMILY_8XY5;
+        case 0x6: return FAMILY_8XY6;
+        case 0x7: return FAMILY_8XY7;
+        case 0xe: return FAMILY_8XYE;
+        }
+        return FAMILY_UNKNOWN;
+    case 0x9: return FAMILY_9XY0;
+    case 0xa: return FAMILY_ANNN;
+    case 0xb: return FAMILY_BNNN;
+    case 0xc: return FAMILY_CXNN;
+    case 0xd: return FAMILY_DXYN;
+    case 0xe:
+        if(low == 0x9e)
+            return FAMILY_EX9E;
+        if(low == 0xa1)
+            return FAMILY_EXA1;
+        return FAMILY_UNKNOWN;
+    case 0xf:
+        switch(low)
+        {
+        case 0x07: return FAMILY_FX07;
+        case 0x0a: return FAMILY_FX0A;
+        case 0x15: return FAMILY_FX15;
+        case 0x18: return FAMILY_FX18;
+        case 0x1e: return FAMILY_FX1E;
+        case 0x29: return FAMILY_FX29;
+        case 0x33: return FAMILY_FX33;
+        case 0x55: return FAMILY_FX55;
+        case 0x65: return FAMILY_FX65;
+        }
+        return FAMILY_UNKNOWN;
+    }
+
+    return FAMILY_UNKNOWN;
+}
+
+const char* Profiler::familyName(unsigned char family)
+{
+    return family < NUM_FAMILIES ? familyNames[family] : familyNames[FAMILY_UNKNOWN];
+}
+
+// Addresses sorted by execution count, most executed first
+std::size_t Profiler::hottest(SpecialRegister* hot, std::size_t count) const
+{
+    std::size_t used = 0;
+
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+        if(addresses[address])
+            hot[used++] = address;
+
+    count = std::min(count, used);
+    std::partial_sort(hot, hot + count, hot + used, [this](SpecialRegister a, SpecialRegister b) {
+        return addresses[a] > addresses[b] || (addresses[a] == addresses[b] && a < b);
+    });
+
+    return count;
+}
@@ -0,0 +1,73 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include "emulator.h"
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+
+#define DEFAULT_HOT_SPOTS 32
+
+enum OpcodeFamily
+{
+    FAMILY_0NNN, FAMILY_00E0, FAMILY_00EE, FAMILY_1NNN, FAMILY_2NNN, FAMILY_3XNN,
+    FAMILY_4XNN, FAMILY_5XY0, FAMILY_6XNN, FAMILY_7XNN, FAMILY_8XY0, FAMILY_8XY1,
+    FAMILY_8XY2, FAMILY_8XY3, FAMILY_8XY4, FAMILY_8XY5, FAMILY_8XY6, FAMILY_8XY7,
+    FAMILY_8XYE, FAMILY_9XY0, FAMILY_ANNN, FAMILY_BNNN, FAMILY_CXNN, FAMILY_DXYN,
+    FAMILY_EX9E, FAMILY_EXA1, FAMILY_FX07, FAMILY_FX0A, FAMILY_FX15, FAMILY_FX18,
+    FAMILY_FX1E, FAMILY_FX29, FAMILY_FX33, FAMILY_FX55, FAMILY_FX65, FAMILY_UNKNOWN,
+    NUM_FAMILIES
+};
+
+struct TimeCounter
+{
+    unsigned long long nanoseconds;
+    unsigned long long calls;
+};
+
+/* Adds the lifetime of the scope to a counter */
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(TimeCounter& counter);
+    ~ScopedTimer();
+private:
+    TimeCounter& counter;
+    std::chrono::steady_clock::time_point start;
+};
+
+/*
+ * Execution counts per opcode family and per address, plus the time spent
+ * placing sprites (DXYN) and presenting frames (IO::draw). The emulator only
+ * touches it behind a single null check, so an unset profiler costs one
+ * predictable branch per block.
+ */
+class Profiler
+{
+public:
+    /* Constructors */
+    Profiler();
+
+    /* Instance methods */
+    void countInstruction(SpecialRegister address, unsigned char family);
+    void countBlock(SpecialRegister address, const DecodedInstruction* block, unsigned char length);
+    TimeCounter& spriteTime();
+    TimeCounter& presentTime();
+    unsigned long long instructions() const;
+    void writeJSON(std::ostream& out, const unsigned char* mem, std::size_t hotSpots = DEFAULT_HOT_SPOTS) const;
+    void writeHotSpots(std::ostream& out, const unsigned char* mem, std::size_t hotSpots = DEFAULT_HOT_SPOTS) const;
+
+    /* Static methods */
+    static unsigned char familyOf(unsigned short instruction);
+    static const char* familyName(unsigned char family);
+private:
+    /* Auxiliary methods */
+    std::size_t hottest(SpecialRegister* hot, std::size_t count) const;
+
+    unsigned long long families[NUM_FAMILIES];
+    unsigned long long addresses[MEMORY_SIZE];
+    TimeCounter sprites;
+    TimeCounter presents;
+};
+
+#endif  // _PROFILER_H
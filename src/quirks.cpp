@@ -0,0 +1,41 @@
+#include "quirks.h"
+
+static const char* profileNames[NUM_QUIRK_PROFILES] = {
+    "default", "vip", "chip48", "schip", "xochip"
+};
+
+const char* quirkProfileName(QuirkProfile profile)
+{
+    return profileNames[(int)profile];
+}
+
+bool parseQuirkProfile(const std::string& name, QuirkProfile& profile)
+{
+    for(int i = 0; i < NUM_QUIRK_PROFILES; i++)
+        if(name == profileNames[i])
+        {
+            profile = (QuirkProfile)i;
+            return true;
+        }
+
+    return false;
+}
+
+bool quirkShiftUsesVY(QuirkProfile profile)
+{
+    switch(profile)
+    {
+    case QuirkProfile::Default:
+        return DefaultQuirks::shiftUsesVY;
+    case QuirkProfile::CosmacVIP:
+        return CosmacVipQuirks::shiftUsesVY;
+    case QuirkProfile::Chip48:
+        return Chip48Quirks::shiftUsesVY;
+    case QuirkProfile::SuperChip:
+        return SuperChipQuirks::shiftUsesVY;
+    case QuirkProfile::XoChip:
+        return XoChipQuirks::shiftUsesVY;
+    }
+
+    return false;
+}
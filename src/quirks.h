@@ -0,0 +1,76 @@
+#ifndef _QUIRKS_H
+#define _QUIRKS_H
+
+#include <string>
+
+/*
+ * Behaviours that differ between CHIP-8 interpreters. Each profile is a
+ * policy type the instruction methods are instantiated with, so every
+ * profile gets its own interpreter and the hot path never tests a quirk.
+ */
+
+enum class QuirkProfile
+{
+    Default,        // What this emulator always did
+    CosmacVIP,
+    Chip48,
+    SuperChip,
+    XoChip
+};
+
+#define NUM_QUIRK_PROFILES 5
+
+/* What FX55 and FX65 leave in I */
+enum MemoryQuirk
+{
+    MEMORY_KEEP_INDEX,          // I is unchanged
+    MEMORY_ADD_X,               // I += X
+    MEMORY_ADD_X_PLUS_ONE       // I += X + 1, I ends past the last register
+};
+
+struct DefaultQuirks
+{
+    static constexpr bool shiftUsesVY = false;              // 8XY6/8XYE shift VY into VX
+    static constexpr MemoryQuirk memory = MEMORY_KEEP_INDEX;
+    static constexpr bool wrapSprites = false;              // DXYN wraps at the edges instead of clipping
+    static constexpr bool jumpUsesVX = false;               // BNNN adds VX instead of V0
+};
+
+struct CosmacVipQuirks
+{
+    static constexpr bool shiftUsesVY = true;
+    static constexpr MemoryQuirk memory = MEMORY_ADD_X_PLUS_ONE;
+    static constexpr bool wrapSprites = false;
+    static constexpr bool jumpUsesVX = false;
+};
+
+struct Chip48Quirks
+{
+    static constexpr bool shiftUsesVY = false;
+    static constexpr MemoryQuirk memory = MEMORY_ADD_X;
+    static constexpr bool wrapSprites = false;
+    static constexpr bool jumpUsesVX = true;
+};
+
+struct SuperChipQuirks
+{
+    static constexpr bool shiftUsesVY = false;
+    static constexpr MemoryQuirk memory = MEMORY_KEEP_INDEX;
+    static constexpr bool wrapSprites = false;
+    static constexpr bool jumpUsesVX = true;
+};
+
+struct XoChipQuirks
+{
+    static constexpr bool shiftUsesVY = true;
+    static constexpr MemoryQuirk memory = MEMORY_ADD_X_PLUS_ONE;
+    static constexpr bool wrapSprites = true;
+    static constexpr bool jumpUsesVX = false;
+};
+
+/* Runtime view of the profiles, for option parsing and the recompiler */
+const char* quirkProfileName(QuirkProfile profile);
+bool parseQuirkProfile(const std::string& name, QuirkProfile& profile);
+bool quirkShiftUsesVY(QuirkProfile profile);
+
+#endif  // _QUIRKS_H
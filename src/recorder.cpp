@@ -0,0 +1,268 @@
+#include "recorder.h"
+#include <cstring>
+#include <stdexcept>
+
+// Bump whenever the records or the layout of MachineState change
+#define LOG_MAGIC "C8RL"
+#define LOG_VERSION 2
+
+/////////////////////////////////////////////////////////////////////////
+
+Recorder::Recorder(std::ostream& out, bool trace)
+    : writer(out), trace(trace), lastCycle(0)
+{
+
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void Recorder::begin(const MachineState& state, unsigned int instructionsPerSecond, QuirkProfile quirks)
+{
+    unsigned short version = LOG_VERSION;
+    unsigned short flags = (trace ? LOG_FLAG_TRACE : 0) | ((int)quirks << LOG_QUIRKS_SHIFT);
+    unsigned int size = sizeof(state);
+
+    writer.write(LOG_MAGIC, 4);
+    writeShort(version);
+    writeShort(flags);
+    writeNumber(instructionsPerSecond, 4);
+    writeNumber(size, 4);
+    writer.write(&state, sizeof(state));
+
+    lastCycle = state.cycles;
+}
+
+void Recorder::recordKeys(unsigned long long cycle, unsigned short keys)
+{
+    unsigned char type = RECORD_KEYS;
+
+    writer.write(&type, 1);
+    writeCycle(cycle);
+    writeShort(keys);
+}
+
+void Recorder::recordFrame(unsigned long long cycle, unsigned long long hash)
+{
+    unsigned char type = RECORD_FRAME;
+
+    writer.write(&type, 1);
+    writeCycle(cycle);
+    writeNumber(hash, 8);
+}
+
+void Recorder::recordStep(SpecialRegister pc, unsigned short opcode, const GeneralRegister* V, SpecialRegister I, const MachineState& after)
+{
+    unsigned char record[1 + 2 + 2 + 2 + 1 + NUM_GENERAL_REGISTERS + 2];
+    unsigned short changed = 0;
+    unsigned int size = 8;
+
+    for(int i = 0; i < NUM_GENERAL_REGISTERS; i++)
+        if(V[i] != after.V[i])
+        {
+            changed |= 1 << i;
+            record[size++] = after.V[i];
+        }
+
+    record[0] = RECORD_STEP;
+    record[1] = pc & 0xff;
+    record[2] = pc >> 8;
+    record[3] = opcode & 0xff;
+    record[4] = opcode >> 8;
+    record[5] = changed & 0xff;
+    record[6] = changed >> 8;
+    record[7] = (I != after.I);
+    if(record[7])
+    {
+        record[size++] = after.I & 0xff;
+        record[size++] = after.I >> 8;
+    }
+
+    writer.write(record, size);
+}
+
+void Recorder::finish()
+{
+    if(!writer.flush())
+        throw std::runtime_error("Could not write the session log");
+}
+
+bool Recorder::tracing() const
+{
+    return trace;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void Recorder::writeCycle(unsigned long long cycle)
+{
+    // LEB128, one byte for any delta below 128
+    unsigned long long delta = cycle - lastCycle;
+    unsigned char bytes[10];
+    int size = 0;
+
+    do
+    {
+        bytes[size] = delta & 0x7f;
+        delta >>= 7;
+        if(delta)
+            bytes[size] |= 0x80;
+        size++;
+    } while(delta);
+
+    writer.write(bytes, size);
+    lastCycle = cycle;
+}
+
+void Recorder::writeShort(unsigned short value)
+{
+    writeNumber(value, 2);
+}
+
+// Little endian whatever the host is
+void Recorder::writeNumber(unsigned long long value, int size)
+{
+    unsigned char bytes[8];
+
+    for(int i = 0; i < size; i++)
+        bytes[i] = (value >> (i * 8)) & 0xff;
+
+    writer.write(bytes, size);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+LogReader::LogReader(std::istream& in)
+    : in(in), flags(0), speed(0), lastCycle(0), initial()
+{
+    char magic[4];
+    unsigned short version = 0;
+    unsigned long long number = 0, size = 0;
+
+    in.read(magic, 4);
+    readShort(version);
+    readShort(flags);
+    readNumber(number, 4);
+    readNumber(size, 4);
+    speed = number;
+    if(!in || std::memcmp(magic, LOG_MAGIC, 4) != 0)
+        throw std::runtime_error("Not a session log");
+    if(version != LOG_VERSION || size != sizeof(MachineState))
+        throw std::runtime_error("Session log was written by an incompatible version");
+    if((flags >> LOG_QUIRKS_SHIFT) >= NUM_QUIRK_PROFILES)
+        throw std::runtime_error("Session log uses an unknown quirk profile");
+
+    in.read((char *)&initial, sizeof(initial));
+    if(!in)
+        throw std::runtime_error("Session log is truncated");
+    if(!CHIP8Emulator::isValidState(initial))
+        throw std::runtime_error("Session log is corrupt");
+
+    lastCycle = initial.cycles;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool LogReader::next(LogRecord& record)
+{
+    unsigned char header[7];
+    int type = in.get();
+
+    if(type == std::istream::traits_type::eof())
+        return false;
+
+    record.type = type;
+
+    switch(type)
+    {
+    case RECORD_KEYS:
+        return readCycle(record.cycle) && readShort(record.keys);
+    case RECORD_FRAME:
+        return readCycle(record.cycle) && readNumber(record.hash, 8);
+    case RECORD_STEP:
+        if(!in.read((char *)header, sizeof(header)))
+            return false;
+
+        record.pc           = header[0] | (header[1] << 8);
+        record.opcode       = header[2] | (header[3] << 8);
+        record.changed      = header[4] | (header[5] << 8);
+        record.indexChanged = header[6];
+
+        for(int i = 0; i < NUM_GENERAL_REGISTERS; i++)
+            if(record.changed & (1 << i))
+                record.V[i] = in.get();
+
+        return !record.indexChanged || readShort(record.I);
+    }
+
+    throw std::runtime_error("Corrupt session log");
+}
+
+const MachineState& LogReader::initialState() const
+{
+    return initial;
+}
+
+unsigned int LogReader::instructionsPerSecond() const
+{
+    return speed;
+}
+
+QuirkProfile LogReader::quirkProfile() const
+{
+    return (QuirkProfile)(flags >> LOG_QUIRKS_SHIFT);
+}
+
+bool LogReader::tracing() const
+{
+    return flags & LOG_FLAG_TRACE;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool LogReader::readCycle(unsigned long long& cycle)
+{
+    unsigned long long delta = 0;
+    int shift = 0;
+    int byte;
+
+    do
+    {
+        byte = in.get();
+        if(byte == std::istream::traits_type::eof() || shift > 63)
+            return false;
+
+        delta |= (unsigned long long)(byte & 0x7f) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+
+    lastCycle += delta;
+    cycle = lastCycle;
+
+    return true;
+}
+
+bool LogReader::readShort(unsigned short& value)
+{
+    unsigned long long number;
+
+    if(!readNumber(number, 2))
+        return false;
+
+    value = number;
+
+    return true;
+}
+
+bool LogReader::readNumber(unsigned long long& value, int size)
+{
+    unsigned char bytes[8];
+
+    if(!in.read((char *)bytes, size))
+        return false;
+
+    value = 0;
+    for(int i = 0; i < size; i++)
+        value |= (unsigned long long)bytes[i] << (i * 8);
+
+    return true;
+}
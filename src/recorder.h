@@ -0,0 +1,100 @@
+#ifndef _RECORDER_H
+#define _RECORDER_H
+
+#include "bufferedwriter.h"
+#include "emulator.h"
+#include <istream>
+#include <ostream>
+
+/*
+ * Session log layout, multi-byte fields are little endian and the state is
+ * a raw dump in host order like a save state:
+ *
+ *   "C8RL" <version:16> <flags:16> <instructions per second:32>
+ *   <state size:32> <MachineState at the start of the session>
+ *
+ * followed by records, each starting with its type byte:
+ *
+ *   'K' <cycle delta:varint> <keys:16>          Keypad changed
+ *   'F' <cycle delta:varint> <frame hash:64>    Frame presented
+ *   'S' <pc:16> <opcode:16> <changed V:16> <I changed:8> <new V...> [<new I:16>]
+ *
+ * Cycle deltas are taken against the previous K or F record. Step records
+ * are only present when the session was traced. The high byte of the flags
+ * holds the quirk profile the session ran with.
+ */
+
+#define LOG_FLAG_TRACE 0x1
+#define LOG_QUIRKS_SHIFT 8
+
+enum LogRecordType
+{
+    RECORD_KEYS  = 'K',
+    RECORD_FRAME = 'F',
+    RECORD_STEP  = 'S'
+};
+
+struct LogRecord
+{
+    unsigned char type;
+    unsigned long long cycle;               // K and F
+    unsigned short keys;                    // K
+    unsigned long long hash;                // F
+    SpecialRegister pc;                     // S
+    unsigned short opcode;                  // S
+    unsigned short changed;                 // S, one bit per register in V
+    GeneralRegister V[NUM_GENERAL_REGISTERS];
+    bool indexChanged;                      // S
+    SpecialRegister I;                      // S
+};
+
+class Recorder
+{
+public:
+    /* Constructors */
+    explicit Recorder(std::ostream& out, bool trace = false);
+
+    /* Instance methods */
+    void begin(const MachineState& state, unsigned int instructionsPerSecond, QuirkProfile quirks = QuirkProfile::Default);
+    void recordKeys(unsigned long long cycle, unsigned short keys);
+    void recordFrame(unsigned long long cycle, unsigned long long hash);
+    void recordStep(SpecialRegister pc, unsigned short opcode, const GeneralRegister* V, SpecialRegister I, const MachineState& after);
+    void finish();
+    bool tracing() const;
+private:
+    /* Auxiliary methods */
+    void writeCycle(unsigned long long cycle);
+    void writeShort(unsigned short value);
+    void writeNumber(unsigned long long value, int size);
+
+    BufferedWriter writer;
+    bool trace;
+    unsigned long long lastCycle;
+};
+
+class LogReader
+{
+public:
+    /* Constructors */
+    explicit LogReader(std::istream& in);
+
+    /* Instance methods */
+    bool next(LogRecord& record);
+    const MachineState& initialState() const;
+    unsigned int instructionsPerSecond() const;
+    QuirkProfile quirkProfile() const;
+    bool tracing() const;
+private:
+    /* Auxiliary methods */
+    bool readCycle(unsigned long long& cycle);
+    bool readShort(unsigned short& value);
+    bool readNumber(unsigned long long& value, int size);
+
+    std::istream& in;
+    unsigned short flags;
+    unsigned int speed;
+    unsigned long long lastCycle;
+    MachineState initial;
+};
+
+#endif  // _RECORDER_H
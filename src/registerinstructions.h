@@ -0,0 +1,152 @@
+#ifndef _REGISTERINSTRUCTIONS_H
+#define _REGISTERINSTRUCTIONS_H
+
+#include "emulator.h"
+
+/*
+ * The instructions a block body may hold, the ones that only touch V and
+ * I and never branch, draw, wait or access memory. Their semantics live
+ * here once: the interpreter runs them on its machine state and code
+ * chip8aot generates calls them on the registers a CompiledBlock gets, so
+ * the two cannot disagree on results or flags. The recompiler compiles
+ * exactly what isBodyInstruction() accepts, --jit-diff checks its output
+ * against these.
+ */
+struct RegisterInstructions
+{
+    static bool isBodyInstruction(unsigned short instruction);
+
+    static void movValue(GeneralRegister* V, RegisterIndex x, RegisterArgument n);         // 6XNN
+    static void addValue(GeneralRegister* V, RegisterIndex x, RegisterArgument n);         // 7XNN
+    static void registerMov(GeneralRegister* V, RegisterIndex x, RegisterIndex y);         // 8XY0
+    static void registerOr(GeneralRegister* V, RegisterIndex x, RegisterIndex y);          // 8XY1
+    static void registerAnd(GeneralRegister* V, RegisterIndex x, RegisterIndex y);         // 8XY2
+    static void registerXor(GeneralRegister* V, RegisterIndex x, RegisterIndex y);         // 8XY3
+    static void registerAdd(GeneralRegister* V, RegisterIndex x, RegisterIndex y);         // 8XY4
+    static void registerSub(GeneralRegister* V, RegisterIndex x, RegisterIndex y);         // 8XY5
+    template<bool shiftUsesVY>
+    static void registerShiftRight(GeneralRegister* V, RegisterIndex x, RegisterIndex y);  // 8XY6
+    static void registerMinus(GeneralRegister* V, RegisterIndex x, RegisterIndex y);       // 8XY7
+    template<bool shiftUsesVY>
+    static void registerShiftLeft(GeneralRegister* V, RegisterIndex x, RegisterIndex y);   // 8XYE
+    static void movAddress(SpecialRegister* I, AddressArgument address);                   // ANNN
+    static void addIndex(GeneralRegister* V, SpecialRegister* I, RegisterIndex x);         // FX1E
+};
+
+// Block terminators are never asked about, the interpreter runs those.
+// 0NNN other than 00E0, unknown 8XYN and FXNN and FX29 do nothing here
+inline bool RegisterInstructions::isBodyInstruction(unsigned short instruction)
+{
+    switch(instruction >> 12)
+    {
+    case 0x0:
+        return instruction != 0x00e0;
+    case 0x6:
+    case 0x7:
+    case 0x8:
+    case 0xa:
+        return true;
+    case 0xf:
+        switch(instruction & 0xff)
+        {
+        case 0x07:
+        case 0x15:
+        case 0x18:
+        case 0x65:
+            return false;
+        }
+        return true;
+    }
+
+    // CXNN, and the timers above, touch more than V and I
+    return false;
+}
+
+inline void RegisterInstructions::movValue(GeneralRegister* V, RegisterIndex x, RegisterArgument n)
+{
+    V[x] = n;
+}
+
+inline void RegisterInstructions::addValue(GeneralRegister* V, RegisterIndex x, RegisterArgument n)
+{
+    V[x] += n;
+}
+
+inline void RegisterInstructions::registerMov(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    V[x] = V[y];
+}
+
+inline void RegisterInstructions::registerOr(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    V[x] |= V[y];
+}
+
+inline void RegisterInstructions::registerAnd(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    V[x] &= V[y];
+}
+
+inline void RegisterInstructions::registerXor(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    V[x] ^= V[y];
+}
+
+inline void RegisterInstructions::registerAdd(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    unsigned short value = ((unsigned short)V[x]) + ((unsigned short)V[y]);
+    
+    V[0xf] = (value > 0xffff);
+    value &= 0xffff;
+    V[x] = value;
+}
+
+inline void RegisterInstructions::registerSub(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    unsigned short value = ((unsigned short)V[x]) - ((unsigned short)V[y]);
+    
+    V[0xf] = (value <= 0xffff);
+    value &= 0xffff;
+    V[x] = value;
+}
+
+template<bool shiftUsesVY>
+inline void RegisterInstructions::registerShiftRight(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    if constexpr(shiftUsesVY)
+        V[x] = V[y];
+
+    V[0xf] = V[x] & 0x01;
+    V[x] >>= 1;
+}
+
+inline void RegisterInstructions::registerMinus(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    unsigned short value = ((unsigned short)V[y]) - ((unsigned short)V[x]);
+    
+    V[0xf] = (value <= 0xffff);
+    value &= 0xffff;
+    V[x] = value;
+}
+
+template<bool shiftUsesVY>
+inline void RegisterInstructions::registerShiftLeft(GeneralRegister* V, RegisterIndex x, RegisterIndex y)
+{
+    if constexpr(shiftUsesVY)
+        V[x] = V[y];
+
+    V[0xf] = V[x] & 0x80;
+    V[x] <<= 1;
+}
+
+inline void RegisterInstructions::movAddress(SpecialRegister* I, AddressArgument address)
+{
+    *I = address;
+}
+
+inline void RegisterInstructions::addIndex(GeneralRegister* V, SpecialRegister* I, RegisterIndex x)
+{
+    *I += V[x];
+}
+
+#endif  // _REGISTERINSTRUCTIONS_H
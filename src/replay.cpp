@@ -0,0 +1,76 @@
+#include "emulator.h"
+#include "json.h"
+#include "replayio.h"
+#include "scheduler.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+int main(int argc, char **argv)
+{
+    ExecutionMode mode = ExecutionMode::Interpreter;
+    int argument = 1;
+
+    for(; argument < argc && argv[argument][0] == '-'; argument++)
+    {
+        std::string option = argv[argument];
+
+        if(option == "--jit")
+            mode = ExecutionMode::Recompiler;
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if(argument >= argc)
+    {
+        std::cerr << "Usage: chip8replay [--jit] session.log" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ifstream file(argv[argument], std::ios::binary);
+        if(!file)
+            throw std::runtime_error(std::string("Could not open ") + argv[argument]);
+
+        LogReader log(file);
+        ReplayIO io(log);
+        CHIP8Emulator emulator(io);
+        Scheduler scheduler(emulator, log.instructionsPerSecond());
+
+        emulator.setExecutionMode(mode);
+        emulator.setQuirkProfile(log.quirkProfile());
+        emulator.restoreState(log.initialState());
+
+        // Same slicing as the recording, just without the sleeping
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while(!io.finished(emulator.cycleCount()))
+            scheduler.runFrame(io);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", emulator.frameHash());
+
+        std::cout << "{\"log\": " << jsonString(argv[argument])
+                  << ", \"cycles\": " << emulator.cycleCount()
+                  << ", \"frames\": " << scheduler.frameCount()
+                  << ", \"frames_checked\": " << io.framesChecked()
+                  << ", \"mismatches\": " << io.mismatches()
+                  << ", \"first_mismatch\": " << io.firstMismatch()
+                  << ", \"frame_hash\": \"" << hash << "\""
+                  << ", \"seconds\": " << seconds << "}" << std::endl;
+
+        return io.mismatches() ? 2 : 0;
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,94 @@
+#include "replayio.h"
+
+ReplayIO::ReplayIO(LogReader& log)
+    : log(log), pending(), hasPending(false), exhausted(false), checked(0), mismatched(0), firstMismatched(0)
+{
+
+}
+
+void ReplayIO::draw(const FrameRow* rows, const FrameRow* dirty)
+{
+    HeadlessIOBase::draw(rows);
+
+    // Frames are recorded as they are presented, the next frame record
+    // belongs to this one
+    if(!peek() || pending.type != RECORD_FRAME)
+    {
+        mismatched++;
+        if(mismatched == 1)
+            firstMismatched = framesDrawn();
+        return;
+    }
+
+    if(pending.hash != CHIP8Emulator::hashFrame(rows))
+    {
+        mismatched++;
+        if(mismatched == 1)
+            firstMismatched = framesDrawn();
+    }
+
+    checked++;
+    hasPending = false;
+}
+
+void ReplayIO::updateKeys(unsigned long long cycle)
+{
+    while(peek() && pending.type == RECORD_KEYS && pending.cycle <= cycle)
+    {
+        for(unsigned char key = 0; key < NUM_KEYS; key++)
+            setKey(key, pending.keys & (1 << key));
+
+        hasPending = false;
+    }
+}
+
+// Keys are polled and frames presented at the end of every frame, a
+// record the run is already past will never be matched. The run
+// diverged and may never present again, count the frame as a mismatch
+// and stop instead of waiting for it
+bool ReplayIO::finished(unsigned long long cycle)
+{
+    if(!peek())
+        return true;
+
+    if(pending.cycle < cycle)
+    {
+        mismatched++;
+        if(mismatched == 1)
+            firstMismatched = framesDrawn() + 1;
+        return true;
+    }
+
+    return false;
+}
+
+unsigned long long ReplayIO::framesChecked() const
+{
+    return checked;
+}
+
+unsigned long long ReplayIO::mismatches() const
+{
+    return mismatched;
+}
+
+unsigned long long ReplayIO::firstMismatch() const
+{
+    return firstMismatched;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool ReplayIO::peek()
+{
+    // Traces describe what happened, replay only needs the inputs and frames
+    while(!hasPending && !exhausted)
+    {
+        if(!log.next(pending))
+            exhausted = true;
+        else if(pending.type != RECORD_STEP)
+            hasPending = true;
+    }
+
+    return hasPending;
+}
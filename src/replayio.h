@@ -0,0 +1,39 @@
+#ifndef _REPLAYIO_H
+#define _REPLAYIO_H
+
+#include "headlessio.h"
+#include "recorder.h"
+
+/*
+ * Headless backend that presses keys from a session log at the cycles
+ * they were recorded and checks every presented frame against the
+ * recorded hash.
+ */
+class ReplayIO final : public HeadlessIOBase
+{
+public:
+    explicit ReplayIO(LogReader& log);
+
+    using HeadlessIOBase::draw;
+    using HeadlessIOBase::updateKeys;
+    virtual void draw(const FrameRow* rows, const FrameRow* dirty) override;
+    virtual void updateKeys(unsigned long long cycle) override;
+
+    bool finished(unsigned long long cycle);
+    unsigned long long framesChecked() const;
+    unsigned long long mismatches() const;
+    unsigned long long firstMismatch() const;
+private:
+    /* Auxiliary methods */
+    bool peek();
+
+    LogReader& log;
+    LogRecord pending;
+    bool hasPending;
+    bool exhausted;
+    unsigned long long checked;
+    unsigned long long mismatched;
+    unsigned long long firstMismatched;
+};
+
+#endif  // _REPLAYIO_H
@@ -0,0 +1,157 @@
+#include "rewind.h"
+#include <cstring>
+#include <utility>
+
+// A token costs four bytes, shorter equal runs are cheaper kept as literals
+#define MIN_SKIP 4
+
+static_assert(sizeof(MachineState) <= 0xffff, "Token lengths are 16 bits wide");
+
+/////////////////////////////////////////////////////////////////////////
+
+RewindBuffer::RewindBuffer(std::size_t capacity, unsigned int keyframeInterval)
+    : capacity(capacity ? capacity : 1), keyframeInterval(keyframeInterval ? keyframeInterval : 1), sinceKeyframe(0), bytes(0), keyframe()
+{
+    // The newest group must fit, dropping it would leave deltas without their keyframe
+    if(this->keyframeInterval > this->capacity)
+        this->keyframeInterval = this->capacity;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void RewindBuffer::record(const MachineState& state)
+{
+    static const MachineState empty = {};
+
+    Snapshot snapshot;
+
+    if(snapshots.empty() || sinceKeyframe == 0 || sinceKeyframe >= keyframeInterval)
+    {
+        // Keyframes are deltas against an all-zero machine, mostly empty memory is free
+        snapshot.keyframe = true;
+        encode((const unsigned char *)&state, (const unsigned char *)&empty, snapshot.data);
+        keyframe = state;
+        sinceKeyframe = 0;
+    }
+    else
+    {
+        snapshot.keyframe = false;
+        encode((const unsigned char *)&state, (const unsigned char *)&keyframe, snapshot.data);
+    }
+    sinceKeyframe++;
+
+    bytes += snapshot.data.size();
+    snapshots.push_back(std::move(snapshot));
+
+    // Deltas are useless without their keyframe, drop the oldest group whole
+    while(snapshots.size() > capacity)
+    {
+        do
+        {
+            bytes -= snapshots.front().data.size();
+            snapshots.pop_front();
+        } while(!snapshots.empty() && !snapshots.front().keyframe);
+    }
+}
+
+bool RewindBuffer::rewind(std::size_t frames, MachineState& state)
+{
+    if(snapshots.empty())
+        return false;
+
+    if(frames >= snapshots.size())
+        frames = snapshots.size() - 1;
+
+    std::size_t target = snapshots.size() - 1 - frames;
+    std::size_t base = target;
+    while(!snapshots[base].keyframe)
+        base--;
+
+    std::memset(&keyframe, 0, sizeof(keyframe));
+    decode(snapshots[base].data, (unsigned char *)&keyframe);
+
+    state = keyframe;
+    if(target != base)
+        decode(snapshots[target].data, (unsigned char *)&state);
+
+    // History continues from the restored frame
+    while(snapshots.size() > target + 1)
+    {
+        bytes -= snapshots.back().data.size();
+        snapshots.pop_back();
+    }
+    sinceKeyframe = target - base + 1;
+
+    return true;
+}
+
+void RewindBuffer::clear()
+{
+    snapshots.clear();
+    sinceKeyframe = 0;
+    bytes = 0;
+}
+
+std::size_t RewindBuffer::size() const
+{
+    return snapshots.size();
+}
+
+std::size_t RewindBuffer::byteSize() const
+{
+    return bytes;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// Tokens are <skip:16> <count:16> followed by count XORed bytes, trailing
+// equal bytes are implied
+void RewindBuffer::encode(const unsigned char* current, const unsigned char* reference, std::vector<unsigned char>& out)
+{
+    const std::size_t size = sizeof(MachineState);
+    std::size_t i = 0;
+
+    while(i < size)
+    {
+        std::size_t start = i;
+        while(i < size && current[i] == reference[i])
+            i++;
+        if(i == size)
+            break;
+
+        std::size_t skip = i - start;
+        std::size_t literal = i;
+        std::size_t equal = 0;
+
+        while(i < size && equal < MIN_SKIP)
+        {
+            equal = (current[i] == reference[i]) ? equal + 1 : 0;
+            i++;
+        }
+        i -= equal;
+
+        std::size_t count = i - literal;
+        out.push_back(skip & 0xff);
+        out.push_back(skip >> 8);
+        out.push_back(count & 0xff);
+        out.push_back(count >> 8);
+        for(std::size_t j = literal; j < i; j++)
+            out.push_back(current[j] ^ reference[j]);
+    }
+}
+
+void RewindBuffer::decode(const std::vector<unsigned char>& data, unsigned char* target)
+{
+    std::size_t position = 0;
+    std::size_t i = 0;
+
+    while(i + 4 <= data.size())
+    {
+        position += data[i] | (data[i + 1] << 8);
+        std::size_t count = data[i + 2] | (data[i + 3] << 8);
+        i += 4;
+
+        for(std::size_t j = 0; j < count; j++)
+            target[position++] ^= data[i++];
+    }
+}
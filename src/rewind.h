@@ -0,0 +1,51 @@
+#ifndef _REWIND_H
+#define _REWIND_H
+
+#include "emulator.h"
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#define DEFAULT_REWIND_FRAMES (60 * 60 * 5)     // Five minutes at 60 Hz
+#define DEFAULT_KEYFRAME_INTERVAL 60
+
+/*
+ * History of machine states, one per frame. Every keyframeInterval-th
+ * snapshot is a keyframe, the rest are stored as the XOR against their
+ * keyframe with runs of zero bytes removed, so an unchanged byte costs
+ * nothing and restoring any frame decodes at most two snapshots.
+ */
+class RewindBuffer
+{
+public:
+    /* Constructors */
+    RewindBuffer(std::size_t capacity = DEFAULT_REWIND_FRAMES, unsigned int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+
+    /* Instance methods */
+    void record(const MachineState& state);
+    bool rewind(std::size_t frames, MachineState& state);
+    void clear();
+    std::size_t size() const;
+    std::size_t byteSize() const;
+private:
+    struct Snapshot
+    {
+        bool keyframe;
+        std::vector<unsigned char> data;
+    };
+
+    /* Auxiliary methods */
+    static void encode(const unsigned char* current, const unsigned char* reference, std::vector<unsigned char>& out);
+    static void decode(const std::vector<unsigned char>& data, unsigned char* target);
+
+    std::deque<Snapshot> snapshots;
+    std::size_t capacity;
+    unsigned int keyframeInterval;
+    unsigned int sinceKeyframe;
+    std::size_t bytes;
+
+    /* The keyframe new deltas are taken against */
+    MachineState keyframe;
+};
+
+#endif  // _REWIND_H
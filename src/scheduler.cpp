@@ -0,0 +1,141 @@
+#include "scheduler.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#define MAX_LAG std::chrono::milliseconds(250)
+
+/////////////////////////////////////////////////////////////////////////
+
+Scheduler::Scheduler(CHIP8Emulator& emulator, unsigned int instructionsPerSecond)
+    : emulator(emulator), instructionsPerSecond(instructionsPerSecond), frames(0), overrun(0), stopping(false), rewind(nullptr), saveFailures(0), saving(false), rewinding(0)
+{
+
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void Scheduler::run()
+{
+    const std::chrono::nanoseconds period(1000000000 / TIMER_FREQUENCY);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+
+    while(!stopping)
+    {
+        handleRequests();
+        runFrame();
+
+        // Deadlines advance by whole periods so sleep jitter never accumulates
+        deadline += period;
+
+        // After a long stall start over instead of bursting to catch up
+        if(std::chrono::steady_clock::now() - deadline > MAX_LAG)
+            deadline = std::chrono::steady_clock::now();
+        else
+            std::this_thread::sleep_until(deadline);
+    }
+}
+
+void Scheduler::runFrame()
+{
+    runSlice();
+    emulator.updateTimers();
+    emulator.updateKeys();
+
+    if(rewind)
+        rewind->record(emulator.machineState());
+
+    // Present at most once per vblank
+    if(emulator.hasNewFrame())
+        emulator.drawFrame();
+}
+
+void Scheduler::runSlice()
+{
+    // Spread the clock evenly when it is not a multiple of the timer rate
+    unsigned long long start = frames * instructionsPerSecond / TIMER_FREQUENCY;
+    unsigned long long end = (frames + 1) * instructionsPerSecond / TIMER_FREQUENCY;
+    frames++;
+
+    // Blocks may run past the slice, charge that to the next one
+    unsigned long budget = end - start;
+    if(overrun >= budget)
+        overrun -= budget;
+    else
+        overrun = emulator.runCycles(budget - overrun) - (budget - overrun);
+}
+
+void Scheduler::stop()
+{
+    stopping = true;
+}
+
+unsigned long long Scheduler::frameCount() const
+{
+    return frames;
+}
+
+void Scheduler::setRewindBuffer(RewindBuffer* buffer)
+{
+    rewind = buffer;
+}
+
+void Scheduler::setStateFile(const std::string& file)
+{
+    stateFile = file;
+}
+
+// Both are safe to call from a signal handler
+void Scheduler::requestSave()
+{
+    saving = true;
+}
+
+void Scheduler::requestRewind(unsigned int frames)
+{
+    rewinding += frames;
+}
+
+unsigned int Scheduler::failedSaves() const
+{
+    return saveFailures;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// Between frames, where the machine is the same as a snapshot would show it
+void Scheduler::handleRequests()
+{
+    if(saving.exchange(false) && !stateFile.empty())
+    {
+        // Written aside and renamed, a failed save never clobbers the last good one
+        std::string partial = stateFile + ".tmp";
+
+        try
+        {
+            std::ofstream out(partial, std::ios::binary);
+            emulator.saveState(out);
+            out.close();
+
+            if(!out || std::rename(partial.c_str(), stateFile.c_str()) != 0)
+                throw std::runtime_error("Could not write " + stateFile);
+        }
+        catch(const std::runtime_error&)
+        {
+            std::remove(partial.c_str());
+            saveFailures++;
+        }
+    }
+
+    unsigned int frames = rewinding.exchange(0);
+    MachineState snapshot;
+
+    // Show the restored screen now, the program may not draw for a while
+    if(frames && rewind && rewind->rewind(frames, snapshot))
+    {
+        emulator.restoreState(snapshot);
+        emulator.drawFrame();
+    }
+}
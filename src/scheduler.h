@@ -0,0 +1,69 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "emulator.h"
+#include "rewind.h"
+#include <atomic>
+#include <string>
+
+#define TIMER_FREQUENCY 60
+
+class Scheduler
+{
+public:
+    /* Constructors */
+    Scheduler(CHIP8Emulator& emulator, unsigned int instructionsPerSecond = DEFAULT_INSTRUCTIONS_PER_SECOND);
+
+    /* Instance methods */
+    void run();
+    void runFrame();
+    template<class Backend>
+    void runFrame(Backend& io);
+    void stop();
+    unsigned long long frameCount() const;
+    void setRewindBuffer(RewindBuffer* buffer);
+    void setStateFile(const std::string& file);
+    void requestSave();
+    void requestRewind(unsigned int frames);
+    unsigned int failedSaves() const;
+private:
+    /* Auxiliary methods */
+    void runSlice();
+    void handleRequests();
+private:
+    CHIP8Emulator& emulator;
+    unsigned int instructionsPerSecond;
+    unsigned long long frames;
+    unsigned long overrun;
+
+    /* Set from other threads or signal handlers to leave run() */
+    std::atomic<bool> stopping;
+
+    /* Receives one snapshot per frame when set, owned by the caller */
+    RewindBuffer* rewind;
+
+    /* Where requestSave() writes, nothing is saved while empty */
+    std::string stateFile;
+    unsigned int saveFailures;
+
+    /* Set from other threads or signal handlers, run() acts on them between frames */
+    std::atomic<bool> saving;
+    std::atomic<unsigned int> rewinding;
+};
+
+// runFrame() for a known backend type, see CHIP8Emulator::drawFrame(Backend&)
+template<class Backend>
+void Scheduler::runFrame(Backend& io)
+{
+    runSlice();
+    emulator.updateTimers(io);
+    emulator.updateKeys(io);
+
+    if(rewind)
+        rewind->record(emulator.machineState());
+
+    if(emulator.hasNewFrame())
+        emulator.drawFrame(io);
+}
+
+#endif  // _SCHEDULER_H
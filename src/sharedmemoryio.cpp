@@ -0,0 +1,229 @@
+#include "sharedmemoryio.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static std::string objectName(const std::string& name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+static SharedDisplay* mapDisplay(const std::string& name, bool create)
+{
+    // Two emulators sharing one name would take turns at the sequence
+    int descriptor = shm_open(name.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if(descriptor < 0 && errno == EEXIST)
+        throw std::runtime_error("Shared memory " + name + " is already in use, pick another name or remove it if no emulator runs");
+    if(descriptor < 0)
+        throw std::runtime_error("Could not open shared memory " + name + ": " + std::strerror(errno));
+
+    if(create && ftruncate(descriptor, sizeof(SharedDisplay)) < 0)
+    {
+        int error = errno;
+        close(descriptor);
+        throw std::runtime_error("Could not size shared memory " + name + ": " + std::strerror(error));
+    }
+
+    void* address = mmap(nullptr, sizeof(SharedDisplay), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    int error = errno;
+    close(descriptor);
+
+    if(address == MAP_FAILED)
+        throw std::runtime_error("Could not map shared memory " + name + ": " + std::strerror(error));
+
+    return (SharedDisplay *)address;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+SharedMemoryIO::SharedMemoryIO(IO& target, const std::string& name)
+    : target(target), name(objectName(name)), display(nullptr), machine(nullptr)
+{
+    display = new (mapDisplay(this->name, true)) SharedDisplay();
+
+    std::memcpy(display->magic, SHARED_MAGIC, sizeof(display->magic));
+    display->version = SHARED_VERSION;
+    display->size    = sizeof(SharedDisplay);
+    display->running.store(1, std::memory_order_release);
+}
+
+SharedMemoryIO::~SharedMemoryIO()
+{
+    display->running.store(0, std::memory_order_release);
+
+    munmap(display, sizeof(SharedDisplay));
+    shm_unlink(name.c_str());
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void SharedMemoryIO::draw(const unsigned char* gfx)
+{
+    FrameRow rows[DISPLAY_LINES] = {};
+
+    for(int y = 0; y < DISPLAY_LINES; y++)
+        for(int x = 0; x < DISPLAY_COLUMNS; x++)
+            rows[y] |= (FrameRow)(gfx[x + (y * DISPLAY_COLUMNS)] & 1) << x;
+
+    draw(rows);
+}
+
+void SharedMemoryIO::draw(const FrameRow* rows)
+{
+    beginWrite();
+    std::memcpy(display->state.rows, rows, sizeof(display->state.rows));
+    display->state.framesPresented++;
+    endWrite();
+
+    target.draw(rows);
+}
+
+void SharedMemoryIO::draw(const FrameRow* rows, const FrameRow* dirty)
+{
+    beginWrite();
+    std::memcpy(display->state.rows, rows, sizeof(display->state.rows));
+    display->state.framesPresented++;
+    endWrite();
+
+    target.draw(rows, dirty);
+}
+
+void SharedMemoryIO::updateKeys()
+{
+    publishMachine();
+    target.updateKeys();
+}
+
+// Polled once per frame, the machine is published with it
+void SharedMemoryIO::updateKeys(unsigned long long cycle)
+{
+    publishMachine();
+    target.updateKeys(cycle);
+}
+
+bool SharedMemoryIO::isKeyPressed(unsigned char keyValue)
+{
+    return (display->input.load(std::memory_order_relaxed) & (1 << (keyValue & 0xf))) || target.isKeyPressed(keyValue);
+}
+
+unsigned short SharedMemoryIO::keyMask()
+{
+    return display->input.load(std::memory_order_relaxed) | target.keyMask();
+}
+
+void SharedMemoryIO::beep(bool on)
+{
+    target.beep(on);
+}
+
+void SharedMemoryIO::watch(const MachineState& newMachine)
+{
+    machine = &newMachine;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void SharedMemoryIO::beginWrite()
+{
+    display->sequence.store(display->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedMemoryIO::endWrite()
+{
+    display->sequence.store(display->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void SharedMemoryIO::publishMachine()
+{
+    SharedState& state = display->state;
+
+    beginWrite();
+    state.frames++;
+
+    if(machine)
+    {
+        state.cycles = machine->cycles;
+        std::memcpy(state.V, machine->V, sizeof(state.V));
+        state.I  = machine->I;
+        state.PC = machine->PC;
+        state.SP = machine->SP;
+        std::memcpy(state.stack, machine->stack, sizeof(state.stack));
+        state.delayTimer = machine->delayTimer;
+        state.soundTimer = machine->soundTimer;
+        state.keys = machine->keys;
+    }
+
+    endWrite();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+SharedMemoryView::SharedMemoryView(const std::string& name)
+    : display(mapDisplay(objectName(name), false))
+{
+    if(std::memcmp(display->magic, SHARED_MAGIC, sizeof(display->magic)) ||
+       display->version != SHARED_VERSION || display->size != sizeof(SharedDisplay))
+    {
+        munmap(display, sizeof(SharedDisplay));
+        throw std::runtime_error(objectName(name) + " is not a CHIP-8 display of this version");
+    }
+}
+
+SharedMemoryView::~SharedMemoryView()
+{
+    munmap(display, sizeof(SharedDisplay));
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// Changes whenever the emulator published something, cheap enough to poll
+uint32_t SharedMemoryView::generation() const
+{
+    return display->sequence.load(std::memory_order_acquire) / 2;
+}
+
+// Copies until no write overlapped the copy. Gives up when the emulator
+// left or never finished a write, a crashed writer leaves sequence odd
+bool SharedMemoryView::read(SharedState& state) const
+{
+    for(unsigned int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++)
+    {
+        uint32_t before = display->sequence.load(std::memory_order_acquire);
+
+        if(before & 1)
+        {
+            if(!running())
+                return false;
+            continue;
+        }
+
+        std::memcpy(&state, &display->state, sizeof(state));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if(display->sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+
+    return false;
+}
+
+bool SharedMemoryView::running() const
+{
+    return display->running.load(std::memory_order_acquire);
+}
+
+// Atomic, so viewers pressing different keys never undo each other
+void SharedMemoryView::setKey(unsigned char keyValue, bool pressed)
+{
+    uint16_t bit = 1 << (keyValue & 0xf);
+
+    if(pressed)
+        display->input.fetch_or(bit, std::memory_order_relaxed);
+    else
+        display->input.fetch_and(~bit, std::memory_order_relaxed);
+}
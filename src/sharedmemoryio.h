@@ -0,0 +1,124 @@
+#ifndef _SHAREDMEMORYIO_H
+#define _SHAREDMEMORYIO_H
+
+#include "emulator.h"
+#include "io.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * Segment layout, one SharedDisplay at the start of a POSIX shared memory
+ * object named like "/chip8". Fields are in host byte order, readers run on
+ * the same machine.
+ *
+ * The emulator is the only writer of state. It makes sequence odd before
+ * it writes and even again after, so a reader that saw the same even
+ * value before and after copying state has a consistent copy. Viewers
+ * press keys by setting bits in input, which is ORed into the keypad at
+ * every poll.
+ */
+
+#define SHARED_MAGIC "C8SM"
+#define SHARED_VERSION 1
+#define DEFAULT_SHARED_NAME "/chip8"
+#define MAX_READ_ATTEMPTS (1 << 20)
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The sequence must be lock free to work across processes");
+static_assert(std::atomic<uint16_t>::is_always_lock_free, "The input mask must be lock free to work across processes");
+
+struct SharedState
+{
+    uint64_t frames;                        // 60 Hz guest frames
+    uint64_t framesPresented;               // Frames the program drew
+    uint64_t cycles;
+    FrameRow rows[DISPLAY_LINES];
+    uint8_t V[NUM_GENERAL_REGISTERS];
+    uint16_t I;
+    uint16_t PC;
+    uint16_t SP;
+    uint16_t stack[STACK_LEVEL];
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint16_t keys;                          // The keypad as the program sees it
+};
+
+struct SharedDisplay
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t size;                          // sizeof(SharedDisplay)
+    std::atomic<uint32_t> running;          // 0 once the emulator left
+    std::atomic<uint32_t> sequence;         // Odd while state is written
+    SharedState state;
+
+    /* Written by viewers, on its own line so polling it never slows the emulator */
+    alignas(64) std::atomic<uint16_t> input;
+};
+
+/*
+ * Publishes the display, registers and counters of a running machine into
+ * a shared memory segment on top of another IO, which still presents and
+ * polls as before. Each frame costs two small copies into the segment and
+ * no system calls. The segment is removed when the backend is destroyed,
+ * viewers that still map it see running drop to 0.
+ */
+class SharedMemoryIO final : public IO
+{
+public:
+    /* Constructors, operators, and destructor */
+    SharedMemoryIO(IO& target, const std::string& name = DEFAULT_SHARED_NAME);
+    SharedMemoryIO(const SharedMemoryIO& other) = delete;
+    SharedMemoryIO& operator=(const SharedMemoryIO& other) = delete;
+    ~SharedMemoryIO();
+
+    /* Video */
+    virtual void draw(const unsigned char* gfx) override;
+    virtual void draw(const FrameRow* rows) override;
+    virtual void draw(const FrameRow* rows, const FrameRow* dirty) override;
+
+    /* Input, the target's keys and the viewers' */
+    virtual void updateKeys() override;
+    virtual void updateKeys(unsigned long long cycle) override;
+    virtual bool isKeyPressed(unsigned char keyValue) override;
+    virtual unsigned short keyMask() override;
+
+    /* Sound */
+    virtual void beep(bool on) override;
+
+    /* Instance methods */
+    void watch(const MachineState& machine);
+private:
+    /* Auxiliary methods */
+    void beginWrite();
+    void endWrite();
+    void publishMachine();
+private:
+    IO& target;
+    std::string name;
+    SharedDisplay* display;
+
+    /* Registers and counters come from here, the IO interface only sees frames */
+    const MachineState* machine;
+};
+
+/* A reader's side of the segment */
+class SharedMemoryView
+{
+public:
+    /* Constructors, operators, and destructor */
+    explicit SharedMemoryView(const std::string& name = DEFAULT_SHARED_NAME);
+    SharedMemoryView(const SharedMemoryView& other) = delete;
+    SharedMemoryView& operator=(const SharedMemoryView& other) = delete;
+    ~SharedMemoryView();
+
+    /* Instance methods */
+    uint32_t generation() const;
+    bool read(SharedState& state) const;
+    bool running() const;
+    void setKey(unsigned char keyValue, bool pressed);
+private:
+    SharedDisplay* display;
+};
+
+#endif  // _SHAREDMEMORYIO_H
@@ -0,0 +1,107 @@
+#include "terminalkeypad.h"
+#include <cctype>
+#include <chrono>
+#include <poll.h>
+#include <unistd.h>
+
+#define KEY_HOLD std::chrono::milliseconds(150)     // Longer than the gap between key repeats
+#define INPUT_POLL_MS 10
+
+static int keypadKey(char c)
+{
+    // Indexed by keypad value
+    static const char layout[] = "x123qweasdzc4rfv";
+
+    for(int key = 0; key < NUM_KEYS; key++)
+        if(layout[key] == c)
+            return key;
+
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+TerminalKeypad::TerminalKeypad()
+    : keys(0), stopping(false)
+{
+
+}
+
+TerminalKeypad::~TerminalKeypad()
+{
+    stop();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void TerminalKeypad::start()
+{
+    if(input.joinable())
+        return;
+
+    stopping = false;
+    input = std::thread(&TerminalKeypad::readKeys, this);
+}
+
+void TerminalKeypad::stop()
+{
+    if(!input.joinable())
+        return;
+
+    stopping = true;
+    input.join();
+}
+
+unsigned short TerminalKeypad::keyMask() const
+{
+    return keys.load(std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// Reads the terminal directly rather than through the display backend,
+// which must only be used from the thread that draws
+void TerminalKeypad::readKeys()
+{
+    std::chrono::steady_clock::time_point lastSeen[NUM_KEYS];
+    pollfd terminal = { STDIN_FILENO, POLLIN, 0 };
+    unsigned short held = 0;
+    char input[64];
+
+    while(!stopping)
+    {
+        if(poll(&terminal, 1, INPUT_POLL_MS) > 0)
+        {
+            ssize_t size = read(STDIN_FILENO, input, sizeof(input));
+
+            // Nothing more will come, release everything
+            if(size <= 0)
+            {
+                keys.store(0, std::memory_order_relaxed);
+                return;
+            }
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            for(ssize_t i = 0; i < size; i++)
+            {
+                // The rest is an escape sequence, arrows and the like
+                if(input[i] == '\x1b')
+                    break;
+
+                int key = keypadKey(std::tolower((unsigned char)input[i]));
+                if(key >= 0)
+                {
+                    held |= 1 << key;
+                    lastSeen[key] = now;
+                }
+            }
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        for(int key = 0; key < NUM_KEYS; key++)
+            if((held & (1 << key)) && now - lastSeen[key] > KEY_HOLD)
+                held &= ~(1 << key);
+
+        keys.store(held, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef _TERMINALKEYPAD_H
+#define _TERMINALKEYPAD_H
+
+#include "io.h"
+#include <atomic>
+#include <thread>
+
+/*
+ * The keypad read straight from the terminal by a thread and published as
+ * one atomic mask, so polling the keys costs a single load. Terminals only
+ * report key presses, a key counts as held until it has not repeated for
+ * a while. The layout is on the left of a QWERTY keyboard:
+ *
+ *   1 2 3 4        1 2 3 C
+ *   q w e r        4 5 6 D
+ *   a s d f   ->   7 8 9 E
+ *   z x c v        A 0 B F
+ *
+ * The owner starts reading once the terminal is in raw mode and stops
+ * before putting it back.
+ */
+class TerminalKeypad
+{
+public:
+    /* Constructors, operators, and destructor */
+    TerminalKeypad();
+    TerminalKeypad(const TerminalKeypad& other) = delete;
+    TerminalKeypad& operator=(const TerminalKeypad& other) = delete;
+    ~TerminalKeypad();
+
+    /* Instance methods */
+    void start();
+    void stop();
+    unsigned short keyMask() const;
+private:
+    /* Auxiliary methods */
+    void readKeys();
+private:
+    std::atomic<unsigned short> keys;
+    std::atomic<bool> stopping;
+    std::thread input;
+};
+
+#endif  // _TERMINALKEYPAD_H
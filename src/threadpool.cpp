@@ -0,0 +1,116 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned int threads)
+    : nextQueue(0), pending(0), stopping(false)
+{
+    if(threads == 0)
+        threads = 1;
+
+    for(unsigned int i = 0; i < threads; i++)
+        queues.emplace_back(new WorkQueue());
+
+    for(unsigned int i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+
+    for(std::thread& worker : workers)
+        worker.join();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::submit(Task task)
+{
+    // Spread submissions round robin, stealing evens out the rest
+    WorkQueue& queue = *queues[nextQueue++ % queues.size()];
+
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        pending++;
+    }
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    workAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard(stateLock);
+
+    allDone.wait(guard, [this] { return pending == 0; });
+}
+
+unsigned int ThreadPool::size() const
+{
+    return workers.size();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void ThreadPool::work(unsigned int index)
+{
+    while(true)
+    {
+        Task task;
+
+        if(pop(index, task) || steal(index, task))
+        {
+            task();
+
+            std::lock_guard<std::mutex> guard(stateLock);
+            if(--pending == 0)
+                allDone.notify_all();
+            continue;
+        }
+
+        // Nothing to pop or steal, sleep until new work shows up
+        std::unique_lock<std::mutex> guard(stateLock);
+        if(stopping)
+            return;
+        workAvailable.wait_for(guard, std::chrono::milliseconds(10));
+    }
+}
+
+bool ThreadPool::pop(unsigned int index, Task& task)
+{
+    WorkQueue& queue = *queues[index];
+    std::lock_guard<std::mutex> guard(queue.lock);
+
+    if(queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+
+    return true;
+}
+
+bool ThreadPool::steal(unsigned int thief, Task& task)
+{
+    for(unsigned int i = 1; i < queues.size(); i++)
+    {
+        WorkQueue& queue = *queues[(thief + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+
+        if(queue.tasks.empty())
+            continue;
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+
+        return true;
+    }
+
+    return false;
+}
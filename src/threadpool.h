@@ -0,0 +1,53 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Task;
+
+class ThreadPool
+{
+public:
+    /* Constructors, operators, and destructor */
+    explicit ThreadPool(unsigned int threads = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+    ~ThreadPool();
+
+    /* Instance methods */
+    void submit(Task task);
+    void wait();
+    unsigned int size() const;
+private:
+    /* Auxiliary methods */
+    void work(unsigned int index);
+    bool pop(unsigned int index, Task& task);
+    bool steal(unsigned int thief, Task& task);
+private:
+    /* One queue per worker, owners pop the back and thieves take the front */
+    struct WorkQueue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> nextQueue;
+
+    /* Idle workers and wait() sleep here */
+    std::mutex stateLock;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    std::atomic<unsigned long> pending;
+    bool stopping;
+};
+
+#endif  // _THREADPOOL_H
@@ -0,0 +1,331 @@
+#include "x86recompiler.h"
+#include "registerinstructions.h"
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define RECOMPILER_SUPPORTED 1
+#else
+#define RECOMPILER_SUPPORTED 0
+#endif
+
+#define MEMORY_SIZE 4096
+#define NUM_INSTRUCTION_SLOTS (MEMORY_SIZE / 2)
+#define MAX_BLOCK_LENGTH 64
+#define ARENA_SIZE (1 << 20)
+#define HOT_THRESHOLD 16
+#define REJECTED 0xffff
+#define FLAG_REGISTER 0xf
+#define ADDRESS(instruction) (instruction & 0xfff)
+#define REGISTER_X(instruction) ((instruction >> 8) & 0xf)
+#define REGISTER_Y(instruction) ((instruction >> 4) & 0xf)
+#define SECOND_ARG(instruction) (instruction & 0xff)
+#define THIRD_ARG(instruction) (instruction & 0xf)
+
+/*
+ * Generated code follows the System V calling convention and is always
+ * a leaf function: rdi is pinned to V and rsi to I for the whole block,
+ * al is the only scratch register. Guest registers are addressed as
+ * byte operands off rdi, so every instruction maps to a handful of
+ * loads and stores without spilling anything.
+ */
+#define MODRM_RDI_DISP8(reg) (0x47 | ((reg) << 3))
+#define MODRM_RSI 0x06
+
+/////////////////////////////////////////////////////////////////////////
+
+X86Recompiler::X86Recompiler(bool shiftUsesVY)
+    : arena(nullptr), arenaSize(0), arenaUsed(0), overflow(false), shiftUsesVY(shiftUsesVY)
+{
+#if RECOMPILER_SUPPORTED
+    // Never writable and executable at once, the arena is only made
+    // writable while a block is emitted
+    void* memory = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(memory != MAP_FAILED)
+    {
+        arena     = (unsigned char*)memory;
+        arenaSize = ARENA_SIZE;
+
+        // Systems that refuse executable mappings get no recompiler
+        if(!setWritable(false))
+        {
+            munmap(arena, arenaSize);
+            arena     = nullptr;
+            arenaSize = 0;
+        }
+    }
+#endif
+
+    entries = new CompiledBlock[NUM_INSTRUCTION_SLOTS]{};
+    lengths = new unsigned char[NUM_INSTRUCTION_SLOTS]{};
+    heat    = new unsigned short[NUM_INSTRUCTION_SLOTS]{};
+    written = new bool[MEMORY_SIZE]{};
+}
+
+X86Recompiler::~X86Recompiler()
+{
+#if RECOMPILER_SUPPORTED
+    if(arena)
+        munmap(arena, arenaSize);
+#endif
+
+    delete[] entries;
+    delete[] lengths;
+    delete[] heat;
+    delete[] written;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+bool X86Recompiler::available() const
+{
+    return arena != nullptr;
+}
+
+CompiledBlock X86Recompiler::lookup(SpecialRegister address, unsigned char length, const unsigned char* mem)
+{
+    unsigned int slot = address / 2;
+
+    if(entries[slot])
+        return entries[slot];
+
+    if(heat[slot] == REJECTED || ++heat[slot] < HOT_THRESHOLD)
+        return nullptr;
+
+    entries[slot] = compile(address, length, mem);
+    lengths[slot] = length;
+    if(!entries[slot] && heat[slot] != 0)
+        heat[slot] = REJECTED;
+
+    return entries[slot];
+}
+
+void X86Recompiler::invalidate(SpecialRegister address, unsigned short length)
+{
+    if(length == 0 || address >= MEMORY_SIZE)
+        return;
+
+    unsigned int last = address + length - 1;
+    if(last >= MEMORY_SIZE)
+        last = MEMORY_SIZE - 1;
+
+    // Written code is left to the interpreter from now on
+    std::memset(&written[address], true, last - address + 1);
+
+    // Blocks starting in the written range are rejected, earlier ones only
+    // lose their code if they reach into it, and are rejected by compile()
+    // once they are hot again
+    unsigned int firstBlock = (address / 2 >= MAX_BLOCK_LENGTH - 1) ? address / 2 - (MAX_BLOCK_LENGTH - 1) : 0;
+    for(unsigned int slot = firstBlock; slot < address / 2; slot++)
+        if(entries[slot] && slot * 2 + lengths[slot] * 2 > address)
+            entries[slot] = nullptr;
+
+    for(unsigned int slot = address / 2; slot <= last / 2; slot++)
+    {
+        entries[slot] = nullptr;
+        heat[slot]    = REJECTED;
+    }
+}
+
+void X86Recompiler::reset()
+{
+    flush();
+    std::memset(written, false, MEMORY_SIZE);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+CompiledBlock X86Recompiler::compile(SpecialRegister address, unsigned char length, const unsigned char* mem)
+{
+    // The terminator always goes through the interpreter, so a lone
+    // terminator has nothing worth compiling
+    if(!available() || length < 2 || wasWritten(address, length * 2))
+        return nullptr;
+
+    size_t start = arenaUsed;
+    bool complete = true;
+
+    if(!setWritable(true))
+        return nullptr;
+
+    for(unsigned int i = 0; complete && i < length - 1u; i++)
+    {
+        SpecialRegister pc = address + i * 2;
+        unsigned short instruction = ((unsigned short)mem[pc]) << 8 | mem[pc+1];
+
+        complete = emitInstruction(instruction);
+    }
+    emit(0xc3);                                             // ret
+
+    if(!setWritable(false))
+        complete = false;
+
+    if(!complete)
+    {
+        arenaUsed = start;
+        overflow  = false;
+        return nullptr;
+    }
+
+    // Out of space: start over with an empty arena, the block gets
+    // compiled again once it is hot
+    if(overflow)
+    {
+        flush();
+        return nullptr;
+    }
+
+    return (CompiledBlock)(arena + start);
+}
+
+bool X86Recompiler::emitInstruction(unsigned short instruction)
+{
+    RegisterIndex x = REGISTER_X(instruction);
+    RegisterIndex y = REGISTER_Y(instruction);
+    RegisterArgument n = SECOND_ARG(instruction);
+    AddressArgument address = ADDRESS(instruction);
+
+    // The same set chip8aot translates and the interpreter runs from
+    // RegisterInstructions, anything else stays in the interpreter
+    if(!RegisterInstructions::isBodyInstruction(instruction))
+        return false;
+
+    switch(instruction >> 12)
+    {
+    case 0x6:
+        emitRegisterOperand(0xc6, x); emit(n);              // mov byte [rdi+x], n
+        return true;
+    case 0x7:
+        emitRegisterOperand(0x80, x); emit(n);              // add byte [rdi+x], n
+        return true;
+    case 0x8:
+        switch(THIRD_ARG(instruction))
+        {
+        case 0x0:
+            emitRegisterOperand(0x8a, y);                   // mov al, [rdi+y]
+            emitRegisterOperand(0x88, x);                   // mov [rdi+x], al
+            return true;
+        case 0x1:
+            emitRegisterOperand(0x8a, y);                   // mov al, [rdi+y]
+            emitRegisterOperand(0x08, x);                   // or [rdi+x], al
+            return true;
+        case 0x2:
+            emitRegisterOperand(0x8a, y);                   // mov al, [rdi+y]
+            emitRegisterOperand(0x20, x);                   // and [rdi+x], al
+            return true;
+        case 0x3:
+            emitRegisterOperand(0x8a, y);                   // mov al, [rdi+y]
+            emitRegisterOperand(0x30, x);                   // xor [rdi+x], al
+            return true;
+        case 0x4:
+            emitRegisterOperand(0x8a, x);                   // mov al, [rdi+x]
+            emitRegisterOperand(0x02, y);                   // add al, [rdi+y]
+            emitRegisterOperand(0xc6, FLAG_REGISTER); emit(0);  // mov byte [rdi+15], 0
+            emitRegisterOperand(0x88, x);                   // mov [rdi+x], al
+            return true;
+        case 0x5:
+            emitRegisterOperand(0x8a, x);                   // mov al, [rdi+x]
+            emitRegisterOperand(0x2a, y);                   // sub al, [rdi+y]
+            emitRegisterOperand(0xc6, FLAG_REGISTER); emit(1);  // mov byte [rdi+15], 1
+            emitRegisterOperand(0x88, x);                   // mov [rdi+x], al
+            return true;
+        case 0x6:
+            if(shiftUsesVY)
+            {
+                emitRegisterOperand(0x8a, y);               // mov al, [rdi+y]
+                emitRegisterOperand(0x88, x);               // mov [rdi+x], al
+            }
+            emitRegisterOperand(0x8a, x);                   // mov al, [rdi+x]
+            emit(0x24); emit(0x01);                         // and al, 0x01
+            emitRegisterOperand(0x88, FLAG_REGISTER);       // mov [rdi+15], al
+            emit(0xd0, MODRM_RDI_DISP8(5), x);              // shr byte [rdi+x], 1
+            return true;
+        case 0x7:
+            emitRegisterOperand(0x8a, y);                   // mov al, [rdi+y]
+            emitRegisterOperand(0x2a, x);                   // sub al, [rdi+x]
+            emitRegisterOperand(0xc6, FLAG_REGISTER); emit(1);  // mov byte [rdi+15], 1
+            emitRegisterOperand(0x88, x);                   // mov [rdi+x], al
+            return true;
+        case 0xe:
+            if(shiftUsesVY)
+            {
+                emitRegisterOperand(0x8a, y);               // mov al, [rdi+y]
+                emitRegisterOperand(0x88, x);               // mov [rdi+x], al
+            }
+            emitRegisterOperand(0x8a, x);                   // mov al, [rdi+x]
+            emit(0x24); emit(0x80);                         // and al, 0x80
+            emitRegisterOperand(0x88, FLAG_REGISTER);       // mov [rdi+15], al
+            emit(0xd0, MODRM_RDI_DISP8(4), x);              // shl byte [rdi+x], 1
+            return true;
+        }
+        return true;
+    case 0xa:
+        emit(0x66); emit(0xc7, MODRM_RSI, address & 0xff);  // mov word [rsi], address
+        emit(address >> 8);
+        return true;
+    case 0xf:
+        switch(n)
+        {
+        case 0x1e:
+            emit(0x0f, 0xb6, MODRM_RDI_DISP8(0)); emit(x);  // movzx eax, byte [rdi+x]
+            emit(0x66, 0x01, MODRM_RSI);                    // add [rsi], ax
+            return true;
+        }
+        return true;
+    }
+
+    // 0NNN other than 00E0 is ignored
+    return true;
+}
+
+bool X86Recompiler::wasWritten(SpecialRegister address, unsigned short length) const
+{
+    for(unsigned int i = address; i < address + length && i < MEMORY_SIZE; i++)
+        if(written[i])
+            return true;
+
+    return false;
+}
+
+void X86Recompiler::flush()
+{
+    arenaUsed = 0;
+    overflow  = false;
+
+    std::memset(entries, 0, sizeof(CompiledBlock) * NUM_INSTRUCTION_SLOTS);
+    std::memset(heat, 0, sizeof(unsigned short) * NUM_INSTRUCTION_SLOTS);
+}
+
+// Flips the whole arena, compiles are rare enough that two system calls
+// per block do not show
+bool X86Recompiler::setWritable(bool writable)
+{
+#if RECOMPILER_SUPPORTED
+    return mprotect(arena, arenaSize, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#else
+    return false;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+void X86Recompiler::emit(unsigned char byte)
+{
+    if(arenaUsed < arenaSize)
+        arena[arenaUsed++] = byte;
+    else
+        overflow = true;
+}
+
+void X86Recompiler::emit(unsigned char first, unsigned char second, unsigned char third)
+{
+    emit(first);
+    emit(second);
+    emit(third);
+}
+
+void X86Recompiler::emitRegisterOperand(unsigned char opcode, RegisterIndex x)
+{
+    emit(opcode, MODRM_RDI_DISP8(0), x);
+}
@@ -0,0 +1,50 @@
+#ifndef _X86RECOMPILER_H
+#define _X86RECOMPILER_H
+
+#include "emulator.h"
+#include <cstddef>
+
+class X86Recompiler
+{
+public:
+    /* Constructors, operators, and destructor */
+    explicit X86Recompiler(bool shiftUsesVY = false);
+    X86Recompiler(const X86Recompiler& other) = delete;
+    X86Recompiler& operator=(const X86Recompiler& other) = delete;
+    ~X86Recompiler();
+
+    /* Instance methods */
+    bool available() const;
+    CompiledBlock lookup(SpecialRegister address, unsigned char length, const unsigned char* mem);
+    void invalidate(SpecialRegister address, unsigned short length);
+    void reset();
+private:
+    /* Auxiliary methods */
+    CompiledBlock compile(SpecialRegister address, unsigned char length, const unsigned char* mem);
+    bool emitInstruction(unsigned short instruction);
+    bool wasWritten(SpecialRegister address, unsigned short length) const;
+    void flush();
+    bool setWritable(bool writable);
+
+    /* Code emission */
+    void emit(unsigned char byte);
+    void emit(unsigned char first, unsigned char second, unsigned char third);
+    void emitRegisterOperand(unsigned char opcode, RegisterIndex x);
+private:
+    /* Executable arena */
+    unsigned char* arena;
+    size_t arenaSize;
+    size_t arenaUsed;
+    bool overflow;
+
+    /* 8XY6 and 8XYE copy VY into VX first (COSMAC VIP quirk) */
+    bool shiftUsesVY;
+
+    /* Per-slot state */
+    CompiledBlock* entries;
+    unsigned char* lengths;                 // In instructions, of the block in entries
+    unsigned short* heat;
+    bool* written;
+};
+
+#endif  // _X86RECOMPILER_H
@@ -0,0 +1,241 @@
+#include "emulator.h"
+#include "debugger.h"
+#include "fuzzer.h"
+#include "headlessio.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#define PROGRAM_LOCATION 0x200
+
+/*
+ * Regression checks for bugs that once slipped through, one function per
+ * bug. Prints each failed check and exits non-zero if there was any.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { if(!(condition)) { std::cerr << __FILE__ << ":" << __LINE__ << ": " << #condition << std::endl; failures++; } } while(0)
+
+/////////////////////////////////////////////////////////////////////////
+
+// A history shorter than one keyframe group used to drop the keyframe it
+// had just taken and keep deltas against nothing
+static void rewindSmallerThanKeyframeGroup()
+{
+    RewindBuffer history(3, 60);
+    MachineState state = {};
+    MachineState restored = {};
+
+    for(unsigned int frame = 0; frame < 9; frame++)
+    {
+        state.cycles = frame;
+        state.V[0]   = frame;
+        history.record(state);
+
+        CHECK(history.size() >= 1 && history.size() <= 3);
+    }
+
+    CHECK(history.rewind(2, restored));
+    CHECK(restored.cycles == 6 && restored.V[0] == 6);
+
+    // History goes on from the restored frame
+    state.cycles = 100;
+    history.record(state);
+    CHECK(history.rewind(1, restored));
+    CHECK(restored.cycles == 6);
+}
+
+// RET used to pop the slot above the return address and land on 0x000
+static void callReturnsAfterTheCall()
+{
+    // 200: CALL 206, 202: JP 202, 206: RET
+    static const unsigned char program[] = { 0x22, 0x06, 0x12, 0x02, 0x00, 0x00, 0x00, 0xEE };
+    HeadlessIO io;
+    CHIP8Emulator emulator(io);
+
+    emulator.writeMemory(PROGRAM_LOCATION, program, sizeof(program));
+    emulator.runFor(2);
+
+    CHECK(emulator.machineState().PC == 0x202);
+    CHECK(emulator.machineState().SP == 0);
+    CHECK(emulator.faults() == 0);
+}
+
+// Idle loop skipping used to run a busy-wait loop straight through a
+// breakpoint inside it, the second stop came at the end of the budget
+static void breakpointInsideBusyWait()
+{
+    // 200: SE V0, 1   202: JP 200
+    static const unsigned char program[] = { 0x30, 0x01, 0x12, 0x00 };
+    HeadlessIO io;
+    CHIP8Emulator emulator(io);
+    Debugger debugger(emulator);
+
+    emulator.writeMemory(PROGRAM_LOCATION, program, sizeof(program));
+    debugger.addBreakpoint({ 0x202, 0, Comparison::Always, 0 });
+
+    CHECK(emulator.runFor(1000) == StopReason::Breakpoint);
+    CHECK(emulator.cycleCount() == 1);
+    CHECK(emulator.runFor(1000) == StopReason::Breakpoint);
+    CHECK(emulator.cycleCount() == 3);
+    CHECK(emulator.skippedCycleCount() == 0);
+}
+
+// Save states from the field were restored as they came, a PC past the
+// end of memory indexed the code cache out of bounds
+static void corruptSaveStateIsRejected()
+{
+    HeadlessIO io;
+    CHIP8Emulator emulator(io);
+    std::ostringstream out;
+
+    emulator.saveState(out);
+
+    const std::string valid = out.str();
+    const std::size_t state = valid.size() - sizeof(MachineState);
+    const SpecialRegister badPC = 0xfff0, badSP = STACK_LEVEL + 1;
+    const unsigned char badBool = 2;
+
+    std::string badFields[3] = { valid, valid, valid };
+    std::memcpy(&badFields[0][state + offsetof(MachineState, PC)], &badPC, sizeof(badPC));
+    std::memcpy(&badFields[1][state + offsetof(MachineState, SP)], &badSP, sizeof(badSP));
+    std::memcpy(&badFields[2][state + offsetof(MachineState, waitingForKey)], &badBool, sizeof(badBool));
+
+    for(const std::string& file : badFields)
+    {
+        std::istringstream in(file);
+        bool rejected = false;
+
+        try
+        {
+            emulator.loadState(in);
+        }
+        catch(const std::runtime_error&)
+        {
+            rejected = true;
+        }
+
+        CHECK(rejected);
+        CHECK(emulator.machineState().PC == 0x200);
+    }
+
+    std::istringstream in(valid);
+    emulator.loadState(in);
+    CHECK(emulator.machineState().PC == 0x200);
+}
+
+// Idle loop skipping needed 64 spare cycles in a slice, at the default
+// 700 instructions per second a frame has 11 and it never ran. Loops now
+// stay parked across frames, which must not change anything they do
+static void idleSkippingMatchesRunning()
+{
+    // 200: LD V0, 60  202: LD DT, V0  204: LD V0, DT  206: SE V0, 0  208: JP 204  20A: JP 200
+    static const unsigned char timerWait[] = { 0x60, 0x3C, 0xF0, 0x15, 0xF0, 0x07, 0x30, 0x00, 0x12, 0x04, 0x12, 0x00 };
+    // 200: LD V0, 0  202: JP 202
+    static const unsigned char selfJump[] = { 0x60, 0x00, 0x12, 0x02 };
+    // 200: LD V0, 5  202: SKP V0  204: JP 202  206: ADD V1, 1  208: JP 202
+    static const unsigned char keyWait[] = { 0x60, 0x05, 0xE0, 0x9E, 0x12, 0x02, 0x71, 0x01, 0x12, 0x02 };
+
+    static const struct { const unsigned char* code; std::size_t size; } programs[] =
+        { { timerWait, sizeof(timerWait) }, { selfJump, sizeof(selfJump) }, { keyWait, sizeof(keyWait) } };
+
+    for(const auto& program : programs)
+        for(ExecutionMode mode : { ExecutionMode::Interpreter, ExecutionMode::Recompiler })
+            for(unsigned int instructionsPerSecond : { DEFAULT_INSTRUCTIONS_PER_SECOND, 3840 })
+            {
+                HeadlessIO io[2];
+                CHIP8Emulator skipping(io[0]), running(io[1]);
+                Scheduler skippingScheduler(skipping, instructionsPerSecond), runningScheduler(running, instructionsPerSecond);
+
+                running.setIdleSkipping(false);
+                for(CHIP8Emulator* emulator : { &skipping, &running })
+                {
+                    emulator->seed(1);
+                    emulator->setExecutionMode(mode);
+                    emulator->writeMemory(PROGRAM_LOCATION, program.code, program.size);
+                }
+
+                bool same = true;
+                for(unsigned int frame = 0; frame < 600 && same; frame++)
+                {
+                    // Key 5 held for a while, the key wait must notice
+                    for(HeadlessIO& keypad : io)
+                        keypad.setKey(5, frame >= 200 && frame < 203);
+
+                    skippingScheduler.runFrame(io[0]);
+                    runningScheduler.runFrame(io[1]);
+
+                    same = !std::memcmp(&skipping.machineState(), &running.machineState(), sizeof(MachineState));
+                }
+
+                CHECK(same);
+                CHECK(running.skippedCycleCount() == 0);
+                if(instructionsPerSecond == DEFAULT_INSTRUCTIONS_PER_SECOND)
+                    CHECK(skipping.skippedCycleCount() > skipping.cycleCount() / 2);
+            }
+}
+
+// Hangs were only found by the wall clock, which a run of a few thousand
+// instructions never gets near, so a program stuck for good went unreported
+static void fuzzerFindsHangs()
+{
+    // 200: LD V0, 0  202: JP 202
+    static const unsigned char selfJump[] = { 0x60, 0x00, 0x12, 0x02 };
+    // 200: LD V0, K  202: JP 200
+    static const unsigned char keyWait[] = { 0xF0, 0x0A, 0x12, 0x00 };
+    // 200: LD V0, 60  202: LD DT, V0  204: LD V0, DT  206: SE V0, 0  208: JP 204  20A: JP 200
+    static const unsigned char timerWait[] = { 0x60, 0x3C, 0xF0, 0x15, 0xF0, 0x07, 0x30, 0x00, 0x12, 0x04, 0x12, 0x00 };
+
+    static const struct { const unsigned char* code; std::size_t size; bool hangs; SpecialRegister address; } programs[] =
+        { { selfJump, sizeof(selfJump), true, 0x202 }, { keyWait, sizeof(keyWait), true, 0x200 }, { timerWait, sizeof(timerWait), false, 0 } };
+
+    // Only a guest-side check can report within the run
+    const FuzzOptions options = { 600, ExecutionMode::Interpreter, QuirkProfile::Default, 0, 1e9, 0 };
+    const std::string rom = "bin/regression.ch8";
+
+    for(const auto& program : programs)
+    {
+        std::ofstream(rom, std::ios::binary).write((const char *)program.code, program.size);
+
+        // Constructing runs the program once without input
+        Fuzzer fuzzer(rom, options);
+
+        CHECK(fuzzer.findings().size() == (program.hangs ? 1 : 0));
+        if(program.hangs && !fuzzer.findings().empty())
+        {
+            CHECK(fuzzer.findings()[0].faults == 0);
+            CHECK(fuzzer.findings()[0].address == program.address);
+        }
+    }
+
+    std::remove(rom.c_str());
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+int main()
+{
+    rewindSmallerThanKeyframeGroup();
+    callReturnsAfterTheCall();
+    breakpointInsideBusyWait();
+    corruptSaveStateIsRejected();
+    idleSkippingMatchesRunning();
+    fuzzerFindsHangs();
+
+    if(failures)
+    {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}